@@ -2,6 +2,7 @@
 #define _MDR_BITPLANE_ENCODER_INTERFACE_HPP
 
 #include <cassert>
+#include "StreamPool.hpp"
 
 namespace MDR {
     namespace concepts {
@@ -13,7 +14,8 @@ namespace MDR {
 
             virtual ~BitplaneEncoderInterface() = default;
 
-            virtual std::vector<uint8_t *> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& streams_sizes) const = 0;
+            // the caller owns the returned streams
+            virtual std::vector<StreamBuffer> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& streams_sizes) const = 0;
 
             virtual T_data * decode(const std::vector<uint8_t const *>& streams, int32_t n, int exp, uint8_t num_bitplanes) = 0;
 
@@ -0,0 +1,262 @@
+#ifndef _MDR_BITPLANE_TRANSPOSE_HPP
+#define _MDR_BITPLANE_TRANSPOSE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include "SIMDUtils.hpp"
+
+namespace MDR {
+    // bit-matrix transpose kernels shared by the bitplane encoders
+    // bitplanes[b] holds bit (num_bitplanes - 1 - b) of data[0..n), element i at bit i
+
+    template<class T_stream, class T_int>
+    inline void encode_bitplanes_scalar(T_int const * data, size_t n, uint8_t num_bitplanes, T_stream * bitplanes){
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            T_stream bitplane_value = 0;
+            for (int i=0; i<n; i++){
+                bitplane_value += (T_stream)((data[i] >> k) & 1u) << i;
+            }
+            bitplanes[num_bitplanes - 1 - k] = bitplane_value;
+        }
+    }
+
+    template<class T_stream, class T_int>
+    inline void decode_bitplanes_scalar(T_stream const * bitplanes, size_t n, uint8_t num_bitplanes, T_int * data){
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            T_stream bitplane_value = bitplanes[num_bitplanes - 1 - k];
+            for (int i=0; i<n; i++){
+                data[i] += ((bitplane_value >> i) & 1u) << k;
+            }
+        }
+    }
+
+#ifdef MDR_X86_SIMD
+    // 32x32 kernels: shift bit k into the sign bit and gather it with movemask, or test it with a mask register
+    __attribute__((target("sse2")))
+    inline void encode_bitplanes_sse2(uint32_t const * data, uint8_t num_bitplanes, uint32_t * bitplanes){
+        __m128i v[8];
+        for(int g=0; g<8; g++) v[g] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data) + g);
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            __m128i shift = _mm_cvtsi32_si128(31 - k);
+            uint32_t bitplane_value = 0;
+            for(int g=0; g<8; g++){
+                bitplane_value |= (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(_mm_sll_epi32(v[g], shift))) << (4 * g);
+            }
+            bitplanes[num_bitplanes - 1 - k] = bitplane_value;
+        }
+    }
+
+    __attribute__((target("sse2")))
+    inline void decode_bitplanes_sse2(uint32_t const * bitplanes, uint8_t num_bitplanes, uint32_t * data){
+        const __m128i lane_bits = _mm_setr_epi32(1, 2, 4, 8);
+        __m128i acc[8];
+        for(int g=0; g<8; g++) acc[g] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data) + g);
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            uint32_t bitplane_value = bitplanes[num_bitplanes - 1 - k];
+            __m128i bit = _mm_set1_epi32(1u << k);
+            for(int g=0; g<8; g++){
+                __m128i selected = _mm_and_si128(_mm_set1_epi32((bitplane_value >> (4 * g)) & 0xf), lane_bits);
+                __m128i mask = _mm_cmpeq_epi32(selected, lane_bits);
+                acc[g] = _mm_add_epi32(acc[g], _mm_and_si128(mask, bit));
+            }
+        }
+        for(int g=0; g<8; g++) _mm_storeu_si128(reinterpret_cast<__m128i*>(data) + g, acc[g]);
+    }
+
+    __attribute__((target("avx2")))
+    inline void encode_bitplanes_avx2(uint32_t const * data, uint8_t num_bitplanes, uint32_t * bitplanes){
+        __m256i v[4];
+        for(int g=0; g<4; g++) v[g] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data) + g);
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            __m128i shift = _mm_cvtsi32_si128(31 - k);
+            uint32_t bitplane_value = 0;
+            for(int g=0; g<4; g++){
+                bitplane_value |= (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_sll_epi32(v[g], shift))) << (8 * g);
+            }
+            bitplanes[num_bitplanes - 1 - k] = bitplane_value;
+        }
+    }
+
+    __attribute__((target("avx2")))
+    inline void decode_bitplanes_avx2(uint32_t const * bitplanes, uint8_t num_bitplanes, uint32_t * data){
+        const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i acc[4];
+        for(int g=0; g<4; g++) acc[g] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data) + g);
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            uint32_t bitplane_value = bitplanes[num_bitplanes - 1 - k];
+            __m256i bit = _mm256_set1_epi32(1u << k);
+            for(int g=0; g<4; g++){
+                __m256i selected = _mm256_and_si256(_mm256_set1_epi32((bitplane_value >> (8 * g)) & 0xff), lane_bits);
+                __m256i mask = _mm256_cmpeq_epi32(selected, lane_bits);
+                acc[g] = _mm256_add_epi32(acc[g], _mm256_and_si256(mask, bit));
+            }
+        }
+        for(int g=0; g<4; g++) _mm256_storeu_si256(reinterpret_cast<__m256i*>(data) + g, acc[g]);
+    }
+
+    __attribute__((target("avx512f")))
+    inline void encode_bitplanes_avx512(uint32_t const * data, uint8_t num_bitplanes, uint32_t * bitplanes){
+        __m512i v0 = _mm512_loadu_si512(data);
+        __m512i v1 = _mm512_loadu_si512(data + 16);
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            __m512i bit = _mm512_set1_epi32(1u << k);
+            uint32_t bitplane_value = (uint32_t) _mm512_test_epi32_mask(v0, bit) | ((uint32_t) _mm512_test_epi32_mask(v1, bit) << 16);
+            bitplanes[num_bitplanes - 1 - k] = bitplane_value;
+        }
+    }
+
+    __attribute__((target("avx512f")))
+    inline void decode_bitplanes_avx512(uint32_t const * bitplanes, uint8_t num_bitplanes, uint32_t * data){
+        __m512i acc0 = _mm512_loadu_si512(data);
+        __m512i acc1 = _mm512_loadu_si512(data + 16);
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            uint32_t bitplane_value = bitplanes[num_bitplanes - 1 - k];
+            __m512i bit = _mm512_set1_epi32(1u << k);
+            acc0 = _mm512_mask_add_epi32(acc0, (__mmask16)(bitplane_value & 0xffff), acc0, bit);
+            acc1 = _mm512_mask_add_epi32(acc1, (__mmask16)(bitplane_value >> 16), acc1, bit);
+        }
+        _mm512_storeu_si512(data, acc0);
+        _mm512_storeu_si512(data + 16, acc1);
+    }
+
+    // 64x64 kernels
+    __attribute__((target("sse2")))
+    inline void encode_bitplanes_sse2(uint64_t const * data, uint8_t num_bitplanes, uint64_t * bitplanes){
+        __m128i v[32];
+        for(int g=0; g<32; g++) v[g] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data) + g);
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            __m128i shift = _mm_cvtsi32_si128(63 - k);
+            uint64_t bitplane_value = 0;
+            for(int g=0; g<32; g++){
+                bitplane_value |= (uint64_t) _mm_movemask_pd(_mm_castsi128_pd(_mm_sll_epi64(v[g], shift))) << (2 * g);
+            }
+            bitplanes[num_bitplanes - 1 - k] = bitplane_value;
+        }
+    }
+
+    __attribute__((target("sse2")))
+    inline void decode_bitplanes_sse2(uint64_t const * bitplanes, uint8_t num_bitplanes, uint64_t * data){
+        // SSE2 has no 64-bit compare: compare the low halves and broadcast them to the whole lane
+        const __m128i lane_bits = _mm_set_epi64x(2, 1);
+        __m128i acc[32];
+        for(int g=0; g<32; g++) acc[g] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data) + g);
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            uint64_t bitplane_value = bitplanes[num_bitplanes - 1 - k];
+            __m128i bit = _mm_set1_epi64x(1ull << k);
+            for(int g=0; g<32; g++){
+                __m128i selected = _mm_and_si128(_mm_set1_epi32((bitplane_value >> (2 * g)) & 0x3), lane_bits);
+                __m128i mask = _mm_shuffle_epi32(_mm_cmpeq_epi32(selected, lane_bits), _MM_SHUFFLE(2, 2, 0, 0));
+                acc[g] = _mm_add_epi64(acc[g], _mm_and_si128(mask, bit));
+            }
+        }
+        for(int g=0; g<32; g++) _mm_storeu_si128(reinterpret_cast<__m128i*>(data) + g, acc[g]);
+    }
+
+    __attribute__((target("avx2")))
+    inline void encode_bitplanes_avx2(uint64_t const * data, uint8_t num_bitplanes, uint64_t * bitplanes){
+        __m256i v[16];
+        for(int g=0; g<16; g++) v[g] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data) + g);
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            __m128i shift = _mm_cvtsi32_si128(63 - k);
+            uint64_t bitplane_value = 0;
+            for(int g=0; g<16; g++){
+                bitplane_value |= (uint64_t) _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_sll_epi64(v[g], shift))) << (4 * g);
+            }
+            bitplanes[num_bitplanes - 1 - k] = bitplane_value;
+        }
+    }
+
+    __attribute__((target("avx2")))
+    inline void decode_bitplanes_avx2(uint64_t const * bitplanes, uint8_t num_bitplanes, uint64_t * data){
+        const __m256i lane_bits = _mm256_setr_epi64x(1, 2, 4, 8);
+        __m256i acc[16];
+        for(int g=0; g<16; g++) acc[g] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data) + g);
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            uint64_t bitplane_value = bitplanes[num_bitplanes - 1 - k];
+            __m256i bit = _mm256_set1_epi64x(1ull << k);
+            for(int g=0; g<16; g++){
+                __m256i selected = _mm256_and_si256(_mm256_set1_epi64x((bitplane_value >> (4 * g)) & 0xf), lane_bits);
+                __m256i mask = _mm256_cmpeq_epi64(selected, lane_bits);
+                acc[g] = _mm256_add_epi64(acc[g], _mm256_and_si256(mask, bit));
+            }
+        }
+        for(int g=0; g<16; g++) _mm256_storeu_si256(reinterpret_cast<__m256i*>(data) + g, acc[g]);
+    }
+
+    __attribute__((target("avx512f")))
+    inline void encode_bitplanes_avx512(uint64_t const * data, uint8_t num_bitplanes, uint64_t * bitplanes){
+        __m512i v[8];
+        for(int g=0; g<8; g++) v[g] = _mm512_loadu_si512(data + 8 * g);
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            __m512i bit = _mm512_set1_epi64(1ull << k);
+            uint64_t bitplane_value = 0;
+            for(int g=0; g<8; g++){
+                bitplane_value |= (uint64_t) _mm512_test_epi64_mask(v[g], bit) << (8 * g);
+            }
+            bitplanes[num_bitplanes - 1 - k] = bitplane_value;
+        }
+    }
+
+    __attribute__((target("avx512f")))
+    inline void decode_bitplanes_avx512(uint64_t const * bitplanes, uint8_t num_bitplanes, uint64_t * data){
+        __m512i acc[8];
+        for(int g=0; g<8; g++) acc[g] = _mm512_loadu_si512(data + 8 * g);
+        for(int k=num_bitplanes - 1; k>=0; k--){
+            uint64_t bitplane_value = bitplanes[num_bitplanes - 1 - k];
+            __m512i bit = _mm512_set1_epi64(1ull << k);
+            for(int g=0; g<8; g++){
+                acc[g] = _mm512_mask_add_epi64(acc[g], (__mmask8)(bitplane_value >> (8 * g)), acc[g], bit);
+            }
+        }
+        for(int g=0; g<8; g++) _mm512_storeu_si512(data + 8 * g, acc[g]);
+    }
+#endif
+
+    // dispatcher: full square blocks of matching widths use the best available kernel, everything else the scalar loop
+    template<class T_stream, class T_int>
+    struct BitplaneTranspose {
+        static void encode(T_int const * data, size_t n, uint8_t num_bitplanes, T_stream * bitplanes){
+            encode_bitplanes_scalar(data, n, num_bitplanes, bitplanes);
+        }
+        static void decode(T_stream const * bitplanes, size_t n, uint8_t num_bitplanes, T_int * data){
+            decode_bitplanes_scalar(bitplanes, n, num_bitplanes, data);
+        }
+    };
+
+    template<class T>
+    struct SquareBitplaneTranspose {
+        static void encode(T const * data, size_t n, uint8_t num_bitplanes, T * bitplanes){
+#ifdef MDR_X86_SIMD
+            if((n == sizeof(T) * 8) && (num_bitplanes <= sizeof(T) * 8)){
+                switch(simd_level()){
+                    case SIMD_AVX512: encode_bitplanes_avx512(data, num_bitplanes, bitplanes); return;
+                    case SIMD_AVX2: encode_bitplanes_avx2(data, num_bitplanes, bitplanes); return;
+                    case SIMD_SSE2: encode_bitplanes_sse2(data, num_bitplanes, bitplanes); return;
+                    default: break;
+                }
+            }
+#endif
+            encode_bitplanes_scalar(data, n, num_bitplanes, bitplanes);
+        }
+        static void decode(T const * bitplanes, size_t n, uint8_t num_bitplanes, T * data){
+#ifdef MDR_X86_SIMD
+            if((n == sizeof(T) * 8) && (num_bitplanes <= sizeof(T) * 8)){
+                switch(simd_level()){
+                    case SIMD_AVX512: decode_bitplanes_avx512(bitplanes, num_bitplanes, data); return;
+                    case SIMD_AVX2: decode_bitplanes_avx2(bitplanes, num_bitplanes, data); return;
+                    case SIMD_SSE2: decode_bitplanes_sse2(bitplanes, num_bitplanes, data); return;
+                    default: break;
+                }
+            }
+#endif
+            decode_bitplanes_scalar(bitplanes, n, num_bitplanes, data);
+        }
+    };
+
+    template<>
+    struct BitplaneTranspose<uint32_t, uint32_t> : public SquareBitplaneTranspose<uint32_t> {};
+
+    template<>
+    struct BitplaneTranspose<uint64_t, uint64_t> : public SquareBitplaneTranspose<uint64_t> {};
+}
+#endif
@@ -0,0 +1,203 @@
+#ifndef _MDR_FIXED_POINT_QUANTIZE_HPP
+#define _MDR_FIXED_POINT_QUANTIZE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include "SIMDUtils.hpp"
+
+namespace MDR {
+    // power-of-two scaling that replaces per-element ldexp in the encoders
+    // multiplying by a normal 2^exp is exact (or identically rounded for subnormal/overflowing results),
+    // so apply() matches ldexp bit for bit; exponents whose 2^exp is not a normal T fall back to ldexp
+    template<class T>
+    struct PowerOfTwoScale {
+        int exp;
+        T scale;
+        bool exact;
+        PowerOfTwoScale(int exp) : exp(exp),
+            exact((exp >= std::numeric_limits<T>::min_exponent - 1) && (exp <= std::numeric_limits<T>::max_exponent - 1)) {
+            scale = exact ? (T) ldexp(1.0, exp) : 0;
+        }
+        inline T apply(T x) const {
+            return exact ? x * scale : ldexp(x, exp);
+        }
+    };
+
+    // shifted[i] = ldexp(data[i], exp)
+    template<class T>
+    inline void scale_block(T const * data, size_t n, const PowerOfTwoScale<T>& s, T * shifted){
+        if(s.exact){
+            for(size_t i=0; i<n; i++) shifted[i] = data[i] * s.scale;
+        }
+        else{
+            for(size_t i=0; i<n; i++) shifted[i] = ldexp(data[i], s.exp);
+        }
+    }
+
+    template<class T_data, class T_int>
+    inline void quantize_block_scalar(T_data const * data, size_t n, const PowerOfTwoScale<T_data>& s, T_int * int_data){
+        if(s.exact){
+            for(size_t i=0; i<n; i++) int_data[i] = (T_int) (data[i] * s.scale);
+        }
+        else{
+            for(size_t i=0; i<n; i++) int_data[i] = (T_int) ldexp(data[i], s.exp);
+        }
+    }
+
+    template<class T_data, class T_int>
+    inline void dequantize_block_scalar(T_int const * int_data, size_t n, const PowerOfTwoScale<T_data>& s, T_data * data){
+        if(s.exact){
+            for(size_t i=0; i<n; i++) data[i] = (T_data) int_data[i] * s.scale;
+        }
+        else{
+            for(size_t i=0; i<n; i++) data[i] = ldexp((T_data) int_data[i], s.exp);
+        }
+    }
+
+#ifdef MDR_X86_SIMD
+    // truncating conversions saturate to the integer indefinite value exactly like the scalar cvtt instructions
+    __attribute__((target("sse2")))
+    inline size_t quantize_sse2(float const * data, size_t n, float scale, int32_t * int_data){
+        const __m128 s = _mm_set1_ps(scale);
+        size_t i = 0;
+        for(; i + 4 <= n; i+=4){
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(int_data + i), _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(data + i), s)));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    inline size_t quantize_avx2(float const * data, size_t n, float scale, int32_t * int_data){
+        const __m256 s = _mm256_set1_ps(scale);
+        size_t i = 0;
+        for(; i + 8 <= n; i+=8){
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(int_data + i), _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_loadu_ps(data + i), s)));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx512f")))
+    inline size_t quantize_avx512(float const * data, size_t n, float scale, int32_t * int_data){
+        const __m512 s = _mm512_set1_ps(scale);
+        size_t i = 0;
+        for(; i + 16 <= n; i+=16){
+            _mm512_storeu_si512(int_data + i, _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_loadu_ps(data + i), s)));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx512f,avx512dq")))
+    inline size_t quantize_avx512dq(double const * data, size_t n, double scale, int64_t * int_data){
+        const __m512d s = _mm512_set1_pd(scale);
+        size_t i = 0;
+        for(; i + 8 <= n; i+=8){
+            _mm512_storeu_si512(int_data + i, _mm512_cvttpd_epi64(_mm512_mul_pd(_mm512_loadu_pd(data + i), s)));
+        }
+        return i;
+    }
+
+    __attribute__((target("sse2")))
+    inline size_t dequantize_sse2(int32_t const * int_data, size_t n, float scale, float * data){
+        const __m128 s = _mm_set1_ps(scale);
+        size_t i = 0;
+        for(; i + 4 <= n; i+=4){
+            _mm_storeu_ps(data + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(int_data + i))), s));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    inline size_t dequantize_avx2(int32_t const * int_data, size_t n, float scale, float * data){
+        const __m256 s = _mm256_set1_ps(scale);
+        size_t i = 0;
+        for(; i + 8 <= n; i+=8){
+            _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(int_data + i))), s));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx512f")))
+    inline size_t dequantize_avx512(int32_t const * int_data, size_t n, float scale, float * data){
+        const __m512 s = _mm512_set1_ps(scale);
+        size_t i = 0;
+        for(; i + 16 <= n; i+=16){
+            _mm512_storeu_ps(data + i, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_loadu_si512(int_data + i)), s));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx512f,avx512dq")))
+    inline size_t dequantize_avx512dq(int64_t const * int_data, size_t n, double scale, double * data){
+        const __m512d s = _mm512_set1_pd(scale);
+        size_t i = 0;
+        for(; i + 8 <= n; i+=8){
+            _mm512_storeu_pd(data + i, _mm512_mul_pd(_mm512_cvtepi64_pd(_mm512_loadu_si512(int_data + i)), s));
+        }
+        return i;
+    }
+#endif
+
+    // int_data[i] = (T_int) ldexp(data[i], exp), truncated toward zero
+    template<class T_data, class T_int>
+    struct FixedPointQuantize {
+        static void quantize(T_data const * data, size_t n, const PowerOfTwoScale<T_data>& s, T_int * int_data){
+            quantize_block_scalar(data, n, s, int_data);
+        }
+        static void dequantize(T_int const * int_data, size_t n, const PowerOfTwoScale<T_data>& s, T_data * data){
+            dequantize_block_scalar(int_data, n, s, data);
+        }
+    };
+
+    template<>
+    struct FixedPointQuantize<float, int32_t> {
+        static void quantize(float const * data, size_t n, const PowerOfTwoScale<float>& s, int32_t * int_data){
+            size_t done = 0;
+#ifdef MDR_X86_SIMD
+            if(s.exact){
+                switch(simd_level()){
+                    case SIMD_AVX512: done = quantize_avx512(data, n, s.scale, int_data); break;
+                    case SIMD_AVX2: done = quantize_avx2(data, n, s.scale, int_data); break;
+                    case SIMD_SSE2: done = quantize_sse2(data, n, s.scale, int_data); break;
+                    default: break;
+                }
+            }
+#endif
+            quantize_block_scalar(data + done, n - done, s, int_data + done);
+        }
+        static void dequantize(int32_t const * int_data, size_t n, const PowerOfTwoScale<float>& s, float * data){
+            size_t done = 0;
+#ifdef MDR_X86_SIMD
+            if(s.exact){
+                switch(simd_level()){
+                    case SIMD_AVX512: done = dequantize_avx512(int_data, n, s.scale, data); break;
+                    case SIMD_AVX2: done = dequantize_avx2(int_data, n, s.scale, data); break;
+                    case SIMD_SSE2: done = dequantize_sse2(int_data, n, s.scale, data); break;
+                    default: break;
+                }
+            }
+#endif
+            dequantize_block_scalar(int_data + done, n - done, s, data + done);
+        }
+    };
+
+    template<>
+    struct FixedPointQuantize<double, int64_t> {
+        static void quantize(double const * data, size_t n, const PowerOfTwoScale<double>& s, int64_t * int_data){
+            size_t done = 0;
+#ifdef MDR_X86_SIMD
+            if(s.exact && simd_has_avx512dq()) done = quantize_avx512dq(data, n, s.scale, int_data);
+#endif
+            quantize_block_scalar(data + done, n - done, s, int_data + done);
+        }
+        static void dequantize(int64_t const * int_data, size_t n, const PowerOfTwoScale<double>& s, double * data){
+            size_t done = 0;
+#ifdef MDR_X86_SIMD
+            if(s.exact && simd_has_avx512dq()) done = dequantize_avx512dq(int_data, n, s.scale, data);
+#endif
+            dequantize_block_scalar(int_data + done, n - done, s, data + done);
+        }
+    };
+}
+#endif
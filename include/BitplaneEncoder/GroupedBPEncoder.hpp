@@ -2,6 +2,9 @@
 #define _MDR_GROUPED_BP_ENCODER_HPP
 
 #include "BitplaneEncoderInterface.hpp"
+#include "BitplaneTranspose.hpp"
+#include "FixedPointQuantize.hpp"
+#include "TileReader.hpp"
 
 namespace MDR {
     // general bitplane encoder that encodes data by block using T_stream type buffer
@@ -15,7 +18,7 @@ namespace MDR {
             static_assert(std::is_integral<T_stream>::value, "GroupedBPBlockEncoder: streams must be unsigned integers.");
         }
 
-        std::vector<uint8_t *> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes) const {
+        std::vector<StreamBuffer> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes) const {
             assert(num_bitplanes > 0);
             // determine block size based on bitplane integer type
             uint32_t block_size = block_size_based_on_bitplane_int_type<T_stream>();
@@ -23,22 +26,25 @@ namespace MDR {
             stream_sizes = std::vector<uint32_t>(num_bitplanes, 0);
             // define fixed point type
             using T_fp = typename std::conditional<std::is_same<T_data, double>::value, uint64_t, uint32_t>::type;
-            std::vector<uint8_t *> streams;
+            std::vector<StreamBuffer> streams;
             for(int i=0; i<num_bitplanes; i++){
-                streams.push_back((uint8_t *) malloc(2 * n / UINT8_BITS + sizeof(T_stream)));
+                streams.push_back(StreamBuffer(2 * n / UINT8_BITS + sizeof(T_stream)));
             }
             std::vector<T_fp> int_data_buffer(block_size, 0);
             std::vector<T_stream *> streams_pos(streams.size());
             for(int i=0; i<streams.size(); i++){
-                streams_pos[i] = reinterpret_cast<T_stream*>(streams[i]);
+                streams_pos[i] = reinterpret_cast<T_stream*>(streams[i].get());
             }
+            std::vector<T_data> shifted_data_buffer(block_size, 0);
+            const PowerOfTwoScale<T_data> scale(num_bitplanes - exp);
             T_data const * data_pos = data;
             int block_id=0;
             for(int i=0; i<n - block_size; i+=block_size){
                 T_stream sign_bitplane = 0;
+                scale_block(data_pos, block_size, scale, shifted_data_buffer.data());
                 for(int j=0; j<block_size; j++){
                     T_data cur_data = *(data_pos++);
-                    T_data shifted_data = ldexp(cur_data, num_bitplanes - exp);
+                    T_data shifted_data = shifted_data_buffer[j];
                     int64_t fix_point = (int64_t) shifted_data;
                     T_stream sign = cur_data < 0;
                     int_data_buffer[j] = sign ? -fix_point : +fix_point;
@@ -50,9 +56,10 @@ namespace MDR {
             {
                 int rest_size = n - block_size * block_id;
                 T_stream sign_bitplane = 0;
+                scale_block(data_pos, rest_size, scale, shifted_data_buffer.data());
                 for(int j=0; j<rest_size; j++){
                     T_data cur_data = *(data_pos++);
-                    T_data shifted_data = ldexp(cur_data, num_bitplanes - exp);
+                    T_data shifted_data = shifted_data_buffer[j];
                     int64_t fix_point = (int64_t) shifted_data;
                     T_stream sign = cur_data < 0;
                     int_data_buffer[j] = sign ? -fix_point : +fix_point;
@@ -61,19 +68,24 @@ namespace MDR {
                 starting_bitplanes[block_id ++] = encode_block(int_data_buffer.data(), rest_size, num_bitplanes, sign_bitplane, streams_pos);
             }
             for(int i=0; i<num_bitplanes; i++){
-                stream_sizes[i] = reinterpret_cast<uint8_t*>(streams_pos[i]) - streams[i];
+                stream_sizes[i] = reinterpret_cast<uint8_t*>(streams_pos[i]) - streams[i].get();
             }
             // merge starting_bitplane with the first bitplane
             uint32_t merged_size = 0;
-            uint8_t * merged = merge_arrays(reinterpret_cast<uint8_t const*>(starting_bitplanes.data()), starting_bitplanes.size() * sizeof(uint8_t), reinterpret_cast<uint8_t*>(streams[0]), stream_sizes[0], merged_size);
-            free(streams[0]);
-            streams[0] = merged;
+            streams[0] = merge_arrays(reinterpret_cast<uint8_t const*>(starting_bitplanes.data()), starting_bitplanes.size() * sizeof(uint8_t), streams[0].get(), stream_sizes[0], merged_size);
             stream_sizes[0] = merged_size;
             return streams;
         }
 
         // only differs in error collection
-        std::vector<uint8_t *> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes, std::vector<double>& level_errors) const {
+        std::vector<StreamBuffer> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes, std::vector<double>& level_errors) const {
+            ArrayTileReader<T_data> tiles(data);
+            return encode_tiles(tiles, n, exp, num_bitplanes, stream_sizes, level_errors);
+        }
+
+        // same as above, but pulls the data tile by tile from a reader (see TileReader.hpp)
+        template<class TileReader>
+        std::vector<StreamBuffer> encode_tiles(TileReader& tiles, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes, std::vector<double>& level_errors) const {
             assert(num_bitplanes > 0);
             // determine block size based on bitplane integer type
             uint32_t block_size = block_size_based_on_bitplane_int_type<T_stream>();
@@ -81,14 +93,14 @@ namespace MDR {
             stream_sizes = std::vector<uint32_t>(num_bitplanes, 0);
             // define fixed point type
             using T_fp = typename std::conditional<std::is_same<T_data, double>::value, uint64_t, uint32_t>::type;
-            std::vector<uint8_t *> streams;
+            std::vector<StreamBuffer> streams;
             for(int i=0; i<num_bitplanes; i++){
-                streams.push_back((uint8_t *) malloc(2 * n / UINT8_BITS + sizeof(T_stream)));
+                streams.push_back(StreamBuffer(2 * n / UINT8_BITS + sizeof(T_stream)));
             }
             std::vector<T_fp> int_data_buffer(block_size, 0);
             std::vector<T_stream *> streams_pos(streams.size());
             for(int i=0; i<streams.size(); i++){
-                streams_pos[i] = reinterpret_cast<T_stream*>(streams[i]);
+                streams_pos[i] = reinterpret_cast<T_stream*>(streams[i].get());
             }
             // init level errors
             level_errors.clear();
@@ -96,13 +108,18 @@ namespace MDR {
             for(int i=0; i<level_errors.size(); i++){
                 level_errors[i] = 0;
             }
-            T_data const * data_pos = data;
+            std::vector<T_data> shifted_data_buffer(block_size, 0);
+            const PowerOfTwoScale<T_data> scale(num_bitplanes - exp);
+            const uint32_t tile_size = (ENCODE_TILE_SIZE / block_size) * block_size;
+            T_data const * data_pos = NULL;
             int block_id=0;
             for(int i=0; i<n - block_size; i+=block_size){
+                if(i % tile_size == 0) data_pos = tiles.next(std::min<size_t>(tile_size, n - i));
                 T_stream sign_bitplane = 0;
+                scale_block(data_pos, block_size, scale, shifted_data_buffer.data());
                 for(int j=0; j<block_size; j++){
                     T_data cur_data = *(data_pos++);
-                    T_data shifted_data = ldexp(cur_data, num_bitplanes - exp);
+                    T_data shifted_data = shifted_data_buffer[j];
                     // compute level errors
                     collect_level_errors(level_errors, fabs(shifted_data), num_bitplanes);
                     int64_t fix_point = (int64_t) shifted_data;
@@ -115,10 +132,12 @@ namespace MDR {
             // leftover
             {
                 int rest_size = n - block_size * block_id;
+                if((n - rest_size) % tile_size == 0) data_pos = tiles.next(rest_size);
                 T_stream sign_bitplane = 0;
+                scale_block(data_pos, rest_size, scale, shifted_data_buffer.data());
                 for(int j=0; j<rest_size; j++){
                     T_data cur_data = *(data_pos++);
-                    T_data shifted_data = ldexp(cur_data, num_bitplanes - exp);
+                    T_data shifted_data = shifted_data_buffer[j];
                     // compute level errors
                     collect_level_errors(level_errors, fabs(shifted_data), num_bitplanes);
                     int64_t fix_point = (int64_t) shifted_data;
@@ -129,13 +148,11 @@ namespace MDR {
                 starting_bitplanes[block_id ++] = encode_block(int_data_buffer.data(), rest_size, num_bitplanes, sign_bitplane, streams_pos);
             }
             for(int i=0; i<num_bitplanes; i++){
-                stream_sizes[i] = reinterpret_cast<uint8_t*>(streams_pos[i]) - streams[i];
+                stream_sizes[i] = reinterpret_cast<uint8_t*>(streams_pos[i]) - streams[i].get();
             }
             // merge starting_bitplane with the first bitplane
             uint32_t merged_size = 0;
-            uint8_t * merged = merge_arrays(reinterpret_cast<uint8_t const*>(starting_bitplanes.data()), starting_bitplanes.size() * sizeof(uint8_t), reinterpret_cast<uint8_t*>(streams[0]), stream_sizes[0], merged_size);
-            free(streams[0]);
-            streams[0] = merged;
+            streams[0] = merge_arrays(reinterpret_cast<uint8_t const*>(starting_bitplanes.data()), starting_bitplanes.size() * sizeof(uint8_t), streams[0].get(), stream_sizes[0], merged_size);
             stream_sizes[0] = merged_size;
             // translate level errors
             for(int i=0; i<level_errors.size(); i++){
@@ -164,6 +181,7 @@ namespace MDR {
 
             std::vector<T_fp> int_data_buffer(block_size, 0);
             // decode
+            const PowerOfTwoScale<T_data> scale(- num_bitplanes + exp);
             T_data * data_pos = data;
             int block_id = 0;
             for(int i=0; i<n - block_size; i+=block_size){
@@ -172,10 +190,11 @@ namespace MDR {
                     memset(int_data_buffer.data(), 0, block_size * sizeof(T_fp));
                     T_stream sign_bitplane = *(streams_pos[recording_bitplane] ++);
                     decode_block(streams_pos, block_size, recording_bitplane, num_bitplanes - recording_bitplane, int_data_buffer.data());
+                    FixedPointQuantize<T_data, T_fp>::dequantize(int_data_buffer.data(), block_size, scale, data_pos);
                     for(int j=0; j<block_size; j++, sign_bitplane >>= 1){
-                        T_data cur_data = ldexp((T_data)int_data_buffer[j], - num_bitplanes + exp);
-                        *(data_pos++) = (sign_bitplane & 1u) ? -cur_data : cur_data;
+                        if(sign_bitplane & 1u) data_pos[j] = - data_pos[j];
                     }
+                    data_pos += block_size;
                 }
                 else{
                     for(int j=0; j<block_size; j++){
@@ -192,10 +211,11 @@ namespace MDR {
                     memset(int_data_buffer.data(), 0, block_size * sizeof(T_fp));
                     sign_bitplane = *(streams_pos[recording_bitplane] ++);
                     decode_block(streams_pos, block_size, recording_bitplane, num_bitplanes - recording_bitplane, int_data_buffer.data());
+                    FixedPointQuantize<T_data, T_fp>::dequantize(int_data_buffer.data(), rest_size, scale, data_pos);
                     for(int j=0; j<rest_size; j++, sign_bitplane >>= 1){
-                        T_data cur_data = ldexp((T_data)int_data_buffer[j], - num_bitplanes + exp);
-                        *(data_pos++) = (sign_bitplane & 1u) ? -cur_data : cur_data;
+                        if(sign_bitplane & 1u) data_pos[j] = - data_pos[j];
                     }
+                    data_pos += rest_size;
                 }
                 else{
                     for(int j=0; j<block_size; j++){
@@ -236,6 +256,7 @@ namespace MDR {
             const std::vector<uint8_t>& recording_bitplanes = level_recording_bitplanes[level];
             std::vector<bool>& signs = level_signs[level];
             const uint8_t ending_bitplane = starting_bitplane + num_bitplanes;
+            const PowerOfTwoScale<T_data> scale(- ending_bitplane + exp);
             // decode
             T_data * data_pos = data;
             int block_id = 0;
@@ -254,10 +275,11 @@ namespace MDR {
                     else{
                         decode_block(streams_pos, block_size, 0, num_bitplanes, int_data_buffer.data());                    
                     }
+                    FixedPointQuantize<T_data, T_fp>::dequantize(int_data_buffer.data(), block_size, scale, data_pos);
                     for(int j=0; j<block_size; j++){
-                        T_data cur_data = ldexp((T_data)int_data_buffer[j], - ending_bitplane + exp);
-                        *(data_pos++) = signs[i + j] ? -cur_data : cur_data;
+                        if(signs[i + j]) data_pos[j] = - data_pos[j];
                     }
+                    data_pos += block_size;
                 }
                 else{
                     for(int j=0; j<block_size; j++){
@@ -282,10 +304,11 @@ namespace MDR {
                     else{
                         decode_block(streams_pos, rest_size, 0, num_bitplanes, int_data_buffer.data());                    
                     }
+                    FixedPointQuantize<T_data, T_fp>::dequantize(int_data_buffer.data(), rest_size, scale, data_pos);
                     for(int j=0; j<rest_size; j++){
-                        T_data cur_data = ldexp((T_data)int_data_buffer[j], - ending_bitplane + exp);
-                        *(data_pos++) = signs[block_size * block_id + j] ? -cur_data : cur_data;
+                        if(signs[block_size * block_id + j]) data_pos[j] = - data_pos[j];
                     }
+                    data_pos += rest_size;
                 }
                 else{
                     for(int j=0; j<rest_size; j++){
@@ -336,14 +359,13 @@ namespace MDR {
 
         template <class T_int>
         inline uint8_t encode_block(T_int const * data, size_t n, uint8_t num_bitplanes, T_stream sign, std::vector<T_stream *>& streams_pos) const {
+            assert(num_bitplanes <= sizeof(T_int) * UINT8_BITS);
+            T_stream bitplanes[sizeof(T_int) * UINT8_BITS];
+            BitplaneTranspose<T_stream, T_int>::encode(data, n, num_bitplanes, bitplanes);
             bool recorded = false;
             uint8_t recording_bitplane = num_bitplanes;
-            for(int k=num_bitplanes - 1; k>=0; k--){
-                T_stream bitplane_value = 0;
-                T_stream bitplane_index = num_bitplanes - 1 - k;
-                for (int i=0; i<n; i++){
-                    bitplane_value += (T_stream)((data[i] >> k) & 1u) << i;
-                }
+            for(int bitplane_index=0; bitplane_index<num_bitplanes; bitplane_index++){
+                T_stream bitplane_value = bitplanes[bitplane_index];
                 if(bitplane_value || recorded){
                     if(!recorded){
                         recorded = true;
@@ -358,22 +380,22 @@ namespace MDR {
 
         template <class T_int>
         inline void decode_block(std::vector<T_stream const *>& streams_pos, size_t n, uint8_t recording_bitplane, uint8_t num_bitplanes, T_int * data) const {
-            for(int k=num_bitplanes - 1; k>=0; k--){
-                T_stream bitplane_index = recording_bitplane + num_bitplanes - 1 - k;
-                T_stream bitplane_value = *(streams_pos[bitplane_index] ++);
-                for (int i=0; i<n; i++){
-                    data[i] += ((bitplane_value >> i) & 1u) << k;
-                }
+            assert(num_bitplanes <= sizeof(T_int) * UINT8_BITS);
+            T_stream bitplanes[sizeof(T_int) * UINT8_BITS];
+            for(int i=0; i<num_bitplanes; i++){
+                bitplanes[i] = *(streams_pos[recording_bitplane + i] ++);
             }
+            BitplaneTranspose<T_stream, T_int>::decode(bitplanes, n, num_bitplanes, data);
         }
 
-        uint8_t * merge_arrays(uint8_t const * array1, uint32_t size1, uint8_t const * array2, uint32_t size2, uint32_t& merged_size) const {
+        StreamBuffer merge_arrays(uint8_t const * array1, uint32_t size1, uint8_t const * array2, uint32_t size2, uint32_t& merged_size) const {
             merged_size = sizeof(uint32_t) + size1 + size2;
-            uint8_t * merged_array = (uint8_t *) malloc(merged_size);
+            StreamBuffer merged(merged_size);
+            uint8_t * merged_array = merged.get();
             *reinterpret_cast<uint32_t*>(merged_array) = size1;
             memcpy(merged_array + sizeof(uint32_t), array1, size1);
             memcpy(merged_array + sizeof(uint32_t) + size1, array2, size2);
-            return merged_array;
+            return merged;
         }
 
         std::vector<std::vector<bool>> level_signs;
@@ -2,6 +2,9 @@
 #define _MDR_NEGABINARY_BP_ENCODER_HPP
 
 #include "BitplaneEncoderInterface.hpp"
+#include "BitplaneTranspose.hpp"
+#include "FixedPointQuantize.hpp"
+#include "TileReader.hpp"
 
 namespace MDR {
     // general bitplane encoder that encodes data by block using T_stream type buffer
@@ -15,7 +18,7 @@ namespace MDR {
             static_assert(std::is_integral<T_stream>::value, "NegaBinaryEncoder: streams must be unsigned integers.");
         }
 
-        std::vector<uint8_t *> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes) const {
+        std::vector<StreamBuffer> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes) const {
             assert(num_bitplanes > 0);
             // leave room for negabinary format
             exp += 2;
@@ -26,21 +29,23 @@ namespace MDR {
             // define fixed point type
             using T_fps = typename std::conditional<std::is_same<T_data, double>::value, int64_t, int32_t>::type;
             using T_fp = typename std::conditional<std::is_same<T_data, double>::value, uint64_t, uint32_t>::type;
-            std::vector<uint8_t *> streams;
+            std::vector<StreamBuffer> streams;
             for(int i=0; i<num_bitplanes; i++){
-                streams.push_back((uint8_t *) malloc(n / UINT8_BITS + sizeof(T_stream)));
+                streams.push_back(StreamBuffer(n / UINT8_BITS + sizeof(T_stream)));
             }
             std::vector<T_fp> int_data_buffer(block_size, 0);
             std::vector<T_stream *> streams_pos(streams.size());
             for(int i=0; i<streams.size(); i++){
-                streams_pos[i] = reinterpret_cast<T_stream*>(streams[i]);
+                streams_pos[i] = reinterpret_cast<T_stream*>(streams[i].get());
             }
+            std::vector<T_fps> signed_int_buffer(block_size, 0);
+            const PowerOfTwoScale<T_data> scale(num_bitplanes - exp);
             T_data const * data_pos = data;
             for(int i=0; i<n - block_size; i+=block_size){
+                FixedPointQuantize<T_data, T_fps>::quantize(data_pos, block_size, scale, signed_int_buffer.data());
+                data_pos += block_size;
                 for(int j=0; j<block_size; j++){
-                    T_data cur_data = *(data_pos++);
-                    T_data shifted_data = ldexp(cur_data, num_bitplanes - exp);
-                    int_data_buffer[j] = binary2negabinary((T_fps) shifted_data);
+                    int_data_buffer[j] = binary2negabinary(signed_int_buffer[j]);
                 }
                 encode_block(int_data_buffer.data(), block_size, num_bitplanes, streams_pos);
             }
@@ -48,21 +53,28 @@ namespace MDR {
             {
                 int rest_size = n % block_size;
                 if(rest_size == 0) rest_size = block_size;
+                FixedPointQuantize<T_data, T_fps>::quantize(data_pos, rest_size, scale, signed_int_buffer.data());
+                data_pos += rest_size;
                 for(int j=0; j<rest_size; j++){
-                    T_data cur_data = *(data_pos++);
-                    T_data shifted_data = ldexp(cur_data, num_bitplanes - exp);
-                    int_data_buffer[j] = binary2negabinary((T_fps) shifted_data);
+                    int_data_buffer[j] = binary2negabinary(signed_int_buffer[j]);
                 }
                 encode_block(int_data_buffer.data(), rest_size, num_bitplanes, streams_pos);
             }
             for(int i=0; i<num_bitplanes; i++){
-                stream_sizes[i] = reinterpret_cast<uint8_t*>(streams_pos[i]) - streams[i];
+                stream_sizes[i] = reinterpret_cast<uint8_t*>(streams_pos[i]) - streams[i].get();
             }
             return streams;
         }
 
         // only differs in error collection
-        std::vector<uint8_t *> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes, std::vector<double>& level_errors) const {
+        std::vector<StreamBuffer> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes, std::vector<double>& level_errors) const {
+            ArrayTileReader<T_data> tiles(data);
+            return encode_tiles(tiles, n, exp, num_bitplanes, stream_sizes, level_errors);
+        }
+
+        // same as above, but pulls the data tile by tile from a reader (see TileReader.hpp)
+        template<class TileReader>
+        std::vector<StreamBuffer> encode_tiles(TileReader& tiles, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes, std::vector<double>& level_errors) const {
             assert(num_bitplanes > 0);
             // leave room for negabinary format
             exp += 2;
@@ -73,14 +85,14 @@ namespace MDR {
             // define fixed point type
             using T_fps = typename std::conditional<std::is_same<T_data, double>::value, int64_t, int32_t>::type;
             using T_fp = typename std::conditional<std::is_same<T_data, double>::value, uint64_t, uint32_t>::type;
-            std::vector<uint8_t *> streams;
+            std::vector<StreamBuffer> streams;
             for(int i=0; i<num_bitplanes; i++){
-                streams.push_back((uint8_t *) malloc(n / UINT8_BITS + sizeof(T_stream)));
+                streams.push_back(StreamBuffer(n / UINT8_BITS + sizeof(T_stream)));
             }
             std::vector<T_fp> int_data_buffer(block_size, 0);
             std::vector<T_stream *> streams_pos(streams.size());
             for(int i=0; i<streams.size(); i++){
-                streams_pos[i] = reinterpret_cast<T_stream*>(streams[i]);
+                streams_pos[i] = reinterpret_cast<T_stream*>(streams[i].get());
             }
             // init level errors
             level_errors.clear();
@@ -88,15 +100,27 @@ namespace MDR {
             for(int i=0; i<level_errors.size(); i++){
                 level_errors[i] = 0;
             }
-            T_data const * data_pos = data;
+            // squared errors indexed by the number of dropped bitplanes, i.e. truncation_errors[k] = level_errors[num_bitplanes - k]
+            std::vector<double> truncation_errors(num_bitplanes + 1, 0);
+            // masks keeping the k lowest negabinary digits
+            std::vector<uint32_t> truncation_masks(num_bitplanes, 0);
+            for(int k=0; k<num_bitplanes; k++){
+                truncation_masks[k] = (1u << (k & 31)) - 1;
+            }
+            std::vector<T_data> shifted_data_buffer(block_size, 0);
+            const PowerOfTwoScale<T_data> scale(num_bitplanes - exp);
+            const uint32_t tile_size = (ENCODE_TILE_SIZE / block_size) * block_size;
+            T_data const * data_pos = NULL;
             for(int i=0; i<n - block_size; i+=block_size){
+                if(i % tile_size == 0) data_pos = tiles.next(std::min<size_t>(tile_size, n - i));
+                scale_block(data_pos, block_size, scale, shifted_data_buffer.data());
+                data_pos += block_size;
                 for(int j=0; j<block_size; j++){
-                    T_data cur_data = *(data_pos++);
-                    T_data shifted_data = ldexp(cur_data, num_bitplanes - exp);
+                    T_data shifted_data = shifted_data_buffer[j];
                     T_fps signed_int_data = (T_fps) shifted_data;
                     int_data_buffer[j] = binary2negabinary(signed_int_data);
                     // compute level errors
-                    collect_level_errors(level_errors, int_data_buffer[j], shifted_data, shifted_data - signed_int_data, num_bitplanes);
+                    collect_level_errors(truncation_errors.data(), truncation_masks.data(), int_data_buffer[j], shifted_data, shifted_data - signed_int_data, num_bitplanes);
                 }
                 encode_block(int_data_buffer.data(), block_size, num_bitplanes, streams_pos);
             }
@@ -104,22 +128,24 @@ namespace MDR {
             {
                 int rest_size = n % block_size;
                 if(rest_size == 0) rest_size = block_size;
+                if((n - rest_size) % tile_size == 0) data_pos = tiles.next(rest_size);
+                scale_block(data_pos, rest_size, scale, shifted_data_buffer.data());
+                data_pos += rest_size;
                 for(int j=0; j<rest_size; j++){
-                    T_data cur_data = *(data_pos++);
-                    T_data shifted_data = ldexp(cur_data, num_bitplanes - exp);
+                    T_data shifted_data = shifted_data_buffer[j];
                     T_fps signed_int_data = (T_fps) shifted_data;
                     int_data_buffer[j] = binary2negabinary(signed_int_data);
                     // compute level errors
-                    collect_level_errors(level_errors, int_data_buffer[j], shifted_data, shifted_data - signed_int_data, num_bitplanes);
+                    collect_level_errors(truncation_errors.data(), truncation_masks.data(), int_data_buffer[j], shifted_data, shifted_data - signed_int_data, num_bitplanes);
                 }
                 encode_block(int_data_buffer.data(), rest_size, num_bitplanes, streams_pos);
             }
             for(int i=0; i<num_bitplanes; i++){
-                stream_sizes[i] = reinterpret_cast<uint8_t*>(streams_pos[i]) - streams[i];
+                stream_sizes[i] = reinterpret_cast<uint8_t*>(streams_pos[i]) - streams[i].get();
             }
             // translate level errors
             for(int i=0; i<level_errors.size(); i++){
-                level_errors[i] = ldexp(level_errors[i], 2*(- num_bitplanes + exp));
+                level_errors[i] = ldexp(truncation_errors[num_bitplanes - i], 2*(- num_bitplanes + exp));
             }
             return streams;
         }
@@ -146,8 +172,10 @@ namespace MDR {
                 streams_pos[i] = reinterpret_cast<T_stream const *>(streams[i]);
             }
             std::vector<T_fp> int_data_buffer(block_size, 0);
+            std::vector<T_fps> signed_int_buffer(block_size, 0);
             // decode
             const uint8_t ending_bitplane = starting_bitplane + num_bitplanes;
+            const PowerOfTwoScale<T_data> scale(- ending_bitplane + exp);
             T_data * data_pos = data;
             // std::cout << "ending_bitplane = " << +ending_bitplane << std::endl;
             if(ending_bitplane % 2 == 0){
@@ -155,8 +183,10 @@ namespace MDR {
                     memset(int_data_buffer.data(), 0, block_size * sizeof(T_fp));
                     decode_block(streams_pos, block_size, num_bitplanes, int_data_buffer.data());
                     for(int j=0; j<block_size; j++){
-                        *(data_pos++) = ldexp((T_data) negabinary2binary(int_data_buffer[j]), - ending_bitplane + exp);
+                        signed_int_buffer[j] = negabinary2binary(int_data_buffer[j]);
                     }
+                    FixedPointQuantize<T_data, T_fps>::dequantize(signed_int_buffer.data(), block_size, scale, data_pos);
+                    data_pos += block_size;
                 }
                 // leftover
                 {
@@ -165,8 +195,10 @@ namespace MDR {
                     memset(int_data_buffer.data(), 0, rest_size * sizeof(T_fp));
                     decode_block(streams_pos, rest_size, num_bitplanes, int_data_buffer.data());
                     for(int j=0; j<rest_size; j++){
-                        *(data_pos++) = ldexp((T_data) negabinary2binary(int_data_buffer[j]), - ending_bitplane + exp);
+                        signed_int_buffer[j] = negabinary2binary(int_data_buffer[j]);
                     }
+                    FixedPointQuantize<T_data, T_fps>::dequantize(signed_int_buffer.data(), rest_size, scale, data_pos);
+                    data_pos += rest_size;
                 }                
             }
             else{
@@ -174,8 +206,13 @@ namespace MDR {
                     memset(int_data_buffer.data(), 0, block_size * sizeof(T_fp));
                     decode_block(streams_pos, block_size, num_bitplanes, int_data_buffer.data());
                     for(int j=0; j<block_size; j++){
-                        *(data_pos++) = - ldexp((T_data) negabinary2binary(int_data_buffer[j]), - ending_bitplane + exp);
+                        signed_int_buffer[j] = negabinary2binary(int_data_buffer[j]);
+                    }
+                    FixedPointQuantize<T_data, T_fps>::dequantize(signed_int_buffer.data(), block_size, scale, data_pos);
+                    for(int j=0; j<block_size; j++){
+                        data_pos[j] = - data_pos[j];
                     }
+                    data_pos += block_size;
                 }
                 // leftover
                 {
@@ -184,8 +221,13 @@ namespace MDR {
                     memset(int_data_buffer.data(), 0, rest_size * sizeof(T_fp));
                     decode_block(streams_pos, rest_size, num_bitplanes, int_data_buffer.data());
                     for(int j=0; j<rest_size; j++){
-                        *(data_pos++) = - ldexp((T_data) negabinary2binary(int_data_buffer[j]), - ending_bitplane + exp);
+                        signed_int_buffer[j] = negabinary2binary(int_data_buffer[j]);
+                    }
+                    FixedPointQuantize<T_data, T_fps>::dequantize(signed_int_buffer.data(), rest_size, scale, data_pos);
+                    for(int j=0; j<rest_size; j++){
+                        data_pos[j] = - data_pos[j];
                     }
+                    data_pos += rest_size;
                 }                
             }
             return data;
@@ -228,35 +270,34 @@ namespace MDR {
         inline int32_t negabinary2binary(const uint32_t x) const {
             return (x ^0xaaaaaaaau) - 0xaaaaaaaau;
         }
-        inline void collect_level_errors(std::vector<double>& level_errors, uint32_t negabinary_data, float data, float mantissa, int num_bitplanes) const {
-            level_errors[num_bitplanes] += mantissa * mantissa;
+        // the k-loop carries no dependence between bitplanes, so it vectorizes
+        // while every error still accumulates over the elements in the original order
+        inline void collect_level_errors(double * __restrict__ truncation_errors, uint32_t const * __restrict__ truncation_masks, uint32_t negabinary_data, float data, float mantissa, int num_bitplanes) const {
+            truncation_errors[0] += mantissa * mantissa;
+            const double mantissa_d = mantissa;
             for(int k=1; k<num_bitplanes; k++){
-                uint32_t mask = (1 << k) - 1;
-                double diff = (double) negabinary2binary(negabinary_data & mask) + mantissa;
-                level_errors[num_bitplanes - k] += diff * diff;
+                double diff = (double) negabinary2binary(negabinary_data & truncation_masks[k]) + mantissa_d;
+                truncation_errors[k] += diff * diff;
             }
-            level_errors[0] += data * data;
+            truncation_errors[num_bitplanes] += data * data;
         }
         template <class T_int>
         inline void encode_block(T_int const * data, size_t n, uint8_t num_bitplanes, std::vector<T_stream *>& streams_pos) const {
-            for(int k=num_bitplanes - 1; k>=0; k--){
-                T_stream bitplane_value = 0;
-                T_stream bitplane_index = num_bitplanes - 1 - k;
-                for (int i=0; i<n; i++){
-                    bitplane_value += (T_stream)((data[i] >> k) & 1u) << i;
-                }
-                *(streams_pos[bitplane_index] ++) = bitplane_value;
+            assert(num_bitplanes <= sizeof(T_int) * UINT8_BITS);
+            T_stream bitplanes[sizeof(T_int) * UINT8_BITS];
+            BitplaneTranspose<T_stream, T_int>::encode(data, n, num_bitplanes, bitplanes);
+            for(int bitplane_index=0; bitplane_index<num_bitplanes; bitplane_index++){
+                *(streams_pos[bitplane_index] ++) = bitplanes[bitplane_index];
             }
         }
         template <class T_int>
         inline void decode_block(std::vector<T_stream const *>& streams_pos, size_t n, uint8_t num_bitplanes, T_int * data) const {
-            for(int k=num_bitplanes - 1; k>=0; k--){
-                T_stream bitplane_index = num_bitplanes - 1 - k;
-                T_stream bitplane_value = *(streams_pos[bitplane_index] ++);
-                for (int i=0; i<n; i++){
-                    data[i] += ((bitplane_value >> i) & 1u) << k;
-                }
+            assert(num_bitplanes <= sizeof(T_int) * UINT8_BITS);
+            T_stream bitplanes[sizeof(T_int) * UINT8_BITS];
+            for(int bitplane_index=0; bitplane_index<num_bitplanes; bitplane_index++){
+                bitplanes[bitplane_index] = *(streams_pos[bitplane_index] ++);
             }
+            BitplaneTranspose<T_stream, T_int>::decode(bitplanes, n, num_bitplanes, data);
         }
     };
 }
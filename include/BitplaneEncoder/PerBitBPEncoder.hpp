@@ -2,6 +2,8 @@
 #define _MDR_PERBIT_BP_ENCODER_HPP
 
 #include "BitplaneEncoderInterface.hpp"
+#include "FixedPointQuantize.hpp"
+#include "TileReader.hpp"
 #include <bitset>
 namespace MDR {
     class BitEncoder{
@@ -78,27 +80,28 @@ namespace MDR {
             static_assert(std::is_integral<T_stream>::value, "PerBitBPEncoder: streams must be unsigned integers.");
         }
 
-        std::vector<uint8_t *> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes) const {
+        std::vector<StreamBuffer> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes) const {
             assert(num_bitplanes > 0);
             // determine block size based on bitplane integer type
             const int32_t block_size = PER_BIT_BLOCK_SIZE;
             stream_sizes = std::vector<uint32_t>(num_bitplanes, 0);
             // define fixed point type
             using T_fp = typename std::conditional<std::is_same<T_data, double>::value, uint64_t, uint32_t>::type;
-            std::vector<uint8_t *> streams;
+            std::vector<StreamBuffer> streams;
             for(int i=0; i<num_bitplanes; i++){
-                streams.push_back((uint8_t *) malloc(2 * n / UINT8_BITS + sizeof(uint64_t)));
+                streams.push_back(StreamBuffer(2 * n / UINT8_BITS + sizeof(uint64_t)));
             }
             std::vector<BitEncoder> encoders;
             for(int i=0; i<streams.size(); i++){
-                encoders.push_back(BitEncoder(reinterpret_cast<uint64_t*>(streams[i])));
+                encoders.push_back(BitEncoder(reinterpret_cast<uint64_t*>(streams[i].get())));
             }
+            const PowerOfTwoScale<T_data> scale(num_bitplanes - exp);
             T_data const * data_pos = data;
             for(int i=0; i<n - block_size; i+=block_size){
                 T_stream sign_bitplane = 0;
                 for(int j=0; j<block_size; j++){
                     T_data cur_data = *(data_pos++);
-                    T_data shifted_data = ldexp(cur_data, num_bitplanes - exp);
+                    T_data shifted_data = scale.apply(cur_data);
                     bool sign = cur_data < 0;
                     int64_t fix_point = (int64_t) shifted_data;
                     T_fp fp_data = sign ? -fix_point : +fix_point;
@@ -121,7 +124,7 @@ namespace MDR {
                 if(rest_size == 0) rest_size = block_size;
                 for(int j=0; j<rest_size; j++){
                     T_data cur_data = *(data_pos++);
-                    T_data shifted_data = ldexp(cur_data, num_bitplanes - exp);
+                    T_data shifted_data = scale.apply(cur_data);
                     bool sign = cur_data < 0;
                     int64_t fix_point = (int64_t) shifted_data;
                     T_fp fp_data = sign ? -fix_point : +fix_point;
@@ -146,20 +149,27 @@ namespace MDR {
         }
 
         // only differs in error collection
-        std::vector<uint8_t *> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes, std::vector<double>& level_errors) const {
+        std::vector<StreamBuffer> encode(T_data const * data, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes, std::vector<double>& level_errors) const {
+            ArrayTileReader<T_data> tiles(data);
+            return encode_tiles(tiles, n, exp, num_bitplanes, stream_sizes, level_errors);
+        }
+
+        // same as above, but pulls the data tile by tile from a reader (see TileReader.hpp)
+        template<class TileReader>
+        std::vector<StreamBuffer> encode_tiles(TileReader& tiles, int32_t n, int32_t exp, uint8_t num_bitplanes, std::vector<uint32_t>& stream_sizes, std::vector<double>& level_errors) const {
             assert(num_bitplanes > 0);
             // determine block size based on bitplane integer type
             const int32_t block_size = PER_BIT_BLOCK_SIZE;
             stream_sizes = std::vector<uint32_t>(num_bitplanes, 0);
             // define fixed point type
             using T_fp = typename std::conditional<std::is_same<T_data, double>::value, uint64_t, uint32_t>::type;
-            std::vector<uint8_t *> streams;
+            std::vector<StreamBuffer> streams;
             for(int i=0; i<num_bitplanes; i++){
-                streams.push_back((uint8_t *) malloc(2 * n / UINT8_BITS + sizeof(uint64_t)));
+                streams.push_back(StreamBuffer(2 * n / UINT8_BITS + sizeof(uint64_t)));
             }
             std::vector<BitEncoder> encoders;
             for(int i=0; i<streams.size(); i++){
-                encoders.push_back(BitEncoder(reinterpret_cast<uint64_t*>(streams[i])));
+                encoders.push_back(BitEncoder(reinterpret_cast<uint64_t*>(streams[i].get())));
             }
             // init level errors
             level_errors.clear();
@@ -167,12 +177,15 @@ namespace MDR {
             for(int i=0; i<level_errors.size(); i++){
                 level_errors[i] = 0;
             }
-            T_data const * data_pos = data;
+            const PowerOfTwoScale<T_data> scale(num_bitplanes - exp);
+            const uint32_t tile_size = (ENCODE_TILE_SIZE / block_size) * block_size;
+            T_data const * data_pos = NULL;
             for(int i=0; i<n - block_size; i+=block_size){
+                if(i % tile_size == 0) data_pos = tiles.next(std::min<size_t>(tile_size, n - i));
                 T_stream sign_bitplane = 0;
                 for(int j=0; j<block_size; j++){
                     T_data cur_data = *(data_pos++);
-                    T_data shifted_data = ldexp(cur_data, num_bitplanes - exp);
+                    T_data shifted_data = scale.apply(cur_data);
                     bool sign = cur_data < 0;
                     int64_t fix_point = (int64_t) shifted_data;
                     T_fp fp_data = sign ? -fix_point : +fix_point;
@@ -194,9 +207,10 @@ namespace MDR {
             {
                 int rest_size = n % block_size;
                 if(rest_size == 0) rest_size = block_size;
+                if((n - rest_size) % tile_size == 0) data_pos = tiles.next(rest_size);
                 for(int j=0; j<rest_size; j++){
                     T_data cur_data = *(data_pos++);
-                    T_data shifted_data = ldexp(cur_data, num_bitplanes - exp);
+                    T_data shifted_data = scale.apply(cur_data);
                     bool sign = cur_data < 0;
                     int64_t fix_point = (int64_t) shifted_data;
                     T_fp fp_data = sign ? -fix_point : +fix_point;
@@ -240,6 +254,7 @@ namespace MDR {
                 decoders[i].size();
             }
             // decode
+            const PowerOfTwoScale<T_data> scale(- num_bitplanes + exp);
             T_data * data_pos = data;
             for(int i=0; i<n - block_size; i+=block_size){
                 for(int j=0; j<block_size; j++){
@@ -257,7 +272,7 @@ namespace MDR {
                             first_bit = false;
                         }
                     }
-                    T_data cur_data = ldexp((T_data)fp_data, - num_bitplanes + exp);
+                    T_data cur_data = scale.apply((T_data)fp_data);
                     *(data_pos++) = sign ? -cur_data : cur_data;
                 }
             }
@@ -280,7 +295,7 @@ namespace MDR {
                             first_bit = false;
                         }
                     }
-                    T_data cur_data = ldexp((T_data)fp_data, - num_bitplanes + exp);
+                    T_data cur_data = scale.apply((T_data)fp_data);
                     *(data_pos++) = sign ? -cur_data : cur_data;
                 }
             }
@@ -309,6 +324,7 @@ namespace MDR {
             std::vector<bool>& flags = sign_flags[level];
             const uint8_t ending_bitplane = starting_bitplane + num_bitplanes;
             // decode
+            const PowerOfTwoScale<T_data> scale(- ending_bitplane + exp);
             T_data * data_pos = data;
             for(int i=0; i<n - block_size; i+=block_size){
                 for(int j=0; j<block_size; j++){
@@ -340,7 +356,7 @@ namespace MDR {
                         }
                         signs[i + j] = sign;
                     }
-                    T_data cur_data = ldexp((T_data)fp_data, - ending_bitplane + exp);
+                    T_data cur_data = scale.apply((T_data)fp_data);
                     *(data_pos++) = sign ? -cur_data : cur_data;
                 }
             }
@@ -375,7 +391,7 @@ namespace MDR {
                         }
                         signs[n - rest_size + j] = sign;
                     }
-                    T_data cur_data = ldexp((T_data)fp_data, - ending_bitplane + exp);
+                    T_data cur_data = scale.apply((T_data)fp_data);
                     *(data_pos++) = sign ? -cur_data : cur_data;
                 }
             }
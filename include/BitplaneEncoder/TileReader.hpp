@@ -0,0 +1,50 @@
+#ifndef _MDR_TILE_READER_HPP
+#define _MDR_TILE_READER_HPP
+
+#include <vector>
+
+namespace MDR {
+    // number of elements an encoder pulls from its tile reader at a time
+    // (rounded down to a multiple of the encoding block size)
+    #define ENCODE_TILE_SIZE 16384
+
+    // tile reader concept: T const * next(size_t count) returns the next count elements to encode
+
+    // tile reader over contiguous data
+    template<class T>
+    class ArrayTileReader {
+    public:
+        ArrayTileReader(T const * data) : data_pos(data) {}
+        T const * next(size_t count){
+            T const * tile = data_pos;
+            data_pos += count;
+            return tile;
+        }
+    private:
+        T const * data_pos;
+    };
+
+    // tile reader that interleaves one level of the decomposed data on demand,
+    // so that the level never needs a full-size buffer
+    template<class T, class Interleaver>
+    class LevelTileReader {
+    public:
+        LevelTileReader(const Interleaver& interleaver, T const * data, const std::vector<uint32_t>& dims, const std::vector<uint32_t>& dims_fine, const std::vector<uint32_t>& dims_coarse)
+            : interleaver(interleaver), data(data), dims(dims), dims_fine(dims_fine), dims_coarse(dims_coarse), offset(0), tile(ENCODE_TILE_SIZE) {}
+        T const * next(size_t count){
+            if(tile.size() < count) tile.resize(count);
+            interleaver.interleave_range(data, dims, dims_fine, dims_coarse, offset, count, tile.data());
+            offset += count;
+            return tile.data();
+        }
+    private:
+        const Interleaver& interleaver;
+        T const * data;
+        const std::vector<uint32_t>& dims;
+        const std::vector<uint32_t>& dims_fine;
+        const std::vector<uint32_t>& dims_coarse;
+        size_t offset;
+        std::vector<T> tile;
+    };
+}
+#endif
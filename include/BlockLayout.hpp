@@ -0,0 +1,268 @@
+#ifndef _MDR_BLOCK_LAYOUT_HPP
+#define _MDR_BLOCK_LAYOUT_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include "RefactorUtils.hpp"
+
+namespace MDR {
+
+    // how a dataset is cut into blocks for block-parallel refactoring
+    enum BlockShape {
+        BLOCK_AUTO = 0,     // best grid over all dimensions (slabs, pencils or cubes)
+        BLOCK_SLAB,         // split the slowest dimension only
+        BLOCK_PENCIL        // split the two slowest dimensions, keep the fastest one whole
+    };
+
+    // choose the number of blocks along each dimension
+    /*
+        @params dims: global dimensions
+        @params num_blocks: requested number of blocks
+        @params shape: allowed split dimensions
+        @params min_extent: minimum extent of a split dimension, e.g. 2^(target_level + 1) for target_level to be reachable
+        grids are ranked by the smallest block extent, then by block surface (more cubic is better),
+        then by fewer splits along fast dimensions (longer contiguous runs);
+        if no grid of num_blocks blocks keeps every split dimension >= min_extent, fewer blocks are used
+    */
+    inline std::vector<uint32_t> choose_block_grid(const std::vector<uint32_t>& dims, uint32_t num_blocks, BlockShape shape, uint32_t min_extent){
+        const int num_dims = dims.size();
+        int num_split_dims = num_dims;
+        if(shape == BLOCK_SLAB) num_split_dims = 1;
+        else if(shape == BLOCK_PENCIL) num_split_dims = std::min(2, num_dims);
+        if(num_dims > 3){
+            std::cerr << "Block partition of dimension higher than 3 is not supported" << std::endl;
+            exit(-1);
+        }
+        min_extent = std::max(min_extent, 1u);
+        for(uint32_t count=std::max(num_blocks, 1u); count>1; count--){
+            std::vector<uint32_t> best_grid;
+            uint32_t best_min_extent = 0;
+            double best_surface = 0;
+            // enumerate count = p[0] * p[1] * p[2]
+            for(uint32_t p0=1; p0<=count; p0++){
+                if(count % p0) continue;
+                for(uint32_t p1=1; p1<=count/p0; p1++){
+                    if((count / p0) % p1) continue;
+                    uint32_t p[3] = {p0, p1, count / p0 / p1};
+                    bool feasible = true;
+                    for(int d=0; d<3; d++){
+                        if((d >= num_split_dims) && (p[d] > 1)) feasible = false;
+                        if((d < num_split_dims) && (p[d] > 1) && (dims[d] / p[d] < min_extent)) feasible = false;
+                    }
+                    if(!feasible) continue;
+                    std::vector<uint32_t> grid(p, p + num_dims);
+                    uint32_t min_ext = dims[0] / grid[0];
+                    double volume = 1;
+                    for(int d=0; d<num_dims; d++){
+                        min_ext = std::min(min_ext, dims[d] / grid[d]);
+                        volume *= (double) dims[d] / grid[d];
+                    }
+                    double surface = 0;
+                    for(int d=0; d<num_dims; d++){
+                        surface += volume / ((double) dims[d] / grid[d]);
+                    }
+                    bool better = best_grid.empty() || (min_ext > best_min_extent)
+                        || ((min_ext == best_min_extent) && (surface < best_surface))
+                        || ((min_ext == best_min_extent) && (surface == best_surface) && std::vector<uint32_t>(grid.rbegin(), grid.rend()) < std::vector<uint32_t>(best_grid.rbegin(), best_grid.rend()));
+                    if(better){
+                        best_grid = grid;
+                        best_min_extent = min_ext;
+                        best_surface = surface;
+                    }
+                }
+            }
+            if(best_grid.size()) return best_grid;
+        }
+        return std::vector<uint32_t>(num_dims, 1);
+    }
+
+    // partition of a row-major array into a grid of blocks; blocks are ordered row-major over the grid
+    class BlockLayout {
+    public:
+        BlockLayout(){}
+
+        // split each dimension as evenly as possible
+        BlockLayout(const std::vector<uint32_t>& dims, const std::vector<uint32_t>& grid) : dims(dims), grid(grid) {
+            const int num_dims = dims.size();
+            std::vector<std::vector<uint32_t>> split_offsets(num_dims), split_dims(num_dims);
+            for(int d=0; d<num_dims; d++){
+                uint32_t offset = 0;
+                for(uint32_t k=0; k<grid[d]; k++){
+                    uint32_t extent = dims[d] / grid[d] + (k < dims[d] % grid[d]);
+                    split_offsets[d].push_back(offset);
+                    split_dims[d].push_back(extent);
+                    offset += extent;
+                }
+            }
+            uint32_t num_blocks = 1;
+            for(int d=0; d<num_dims; d++){
+                num_blocks *= grid[d];
+            }
+            for(uint32_t b=0; b<num_blocks; b++){
+                std::vector<uint32_t> offset(num_dims), extent(num_dims);
+                uint32_t rest = b;
+                for(int d=num_dims-1; d>=0; d--){
+                    offset[d] = split_offsets[d][rest % grid[d]];
+                    extent[d] = split_dims[d][rest % grid[d]];
+                    rest /= grid[d];
+                }
+                block_offsets.push_back(offset);
+                block_dims.push_back(extent);
+            }
+        }
+
+        uint32_t num_blocks() const {
+            return block_dims.size();
+        }
+
+        size_t block_elements(uint32_t b) const {
+            size_t n = 1;
+            for(const auto& d:block_dims[b]){
+                n *= d;
+            }
+            return n;
+        }
+
+        // blocks are contiguous in the global array if only the slowest dimension is split
+        bool contiguous() const {
+            for(int d=1; d<grid.size(); d++){
+                if(grid[d] > 1) return false;
+            }
+            return true;
+        }
+
+        // position of the first element of block b in the global array
+        size_t global_offset(uint32_t b) const {
+            size_t offset = 0;
+            for(int d=0; d<dims.size(); d++){
+                offset = offset * dims[d] + block_offsets[b][d];
+            }
+            return offset;
+        }
+
+        // copy block b out of / into the global array
+        template<class T>
+        void gather(T const * global_data, uint32_t b, T * block_data) const {
+            for_each_line(b, [&](size_t global_pos, size_t block_pos, size_t length){
+                memcpy(block_data + block_pos, global_data + global_pos, length * sizeof(T));
+            });
+        }
+        template<class T>
+        void scatter(T const * block_data, uint32_t b, T * global_data) const {
+            for_each_line(b, [&](size_t global_pos, size_t block_pos, size_t length){
+                memcpy(global_data + global_pos, block_data + block_pos, length * sizeof(T));
+            });
+        }
+
+        // blocks intersecting the box [begin, end) of the global array
+        std::vector<uint32_t> blocks_in_region(const std::vector<uint32_t>& begin, const std::vector<uint32_t>& end) const {
+            std::vector<uint32_t> blocks;
+            for(uint32_t b=0; b<num_blocks(); b++){
+                bool intersects = true;
+                for(int d=0; d<dims.size(); d++){
+                    if((block_offsets[b][d] >= end[d]) || (block_offsets[b][d] + block_dims[b][d] <= begin[d])) intersects = false;
+                }
+                if(intersects) blocks.push_back(b);
+            }
+            return blocks;
+        }
+
+        // copy the part of block b inside the box [begin, end) into region_data, a compact array of the box
+        template<class T>
+        void crop(T const * block_data, uint32_t b, const std::vector<uint32_t>& begin, const std::vector<uint32_t>& end, T * region_data) const {
+            const int num_dims = dims.size();
+            std::vector<uint32_t> lo(num_dims), hi(num_dims);
+            for(int d=0; d<num_dims; d++){
+                lo[d] = std::max(begin[d], block_offsets[b][d]);
+                hi[d] = std::min(end[d], block_offsets[b][d] + block_dims[b][d]);
+                if(lo[d] >= hi[d]) return;
+            }
+            const size_t length = hi[num_dims - 1] - lo[num_dims - 1];
+            std::vector<uint32_t> index(lo);
+            while(true){
+                size_t block_pos = 0;
+                size_t region_pos = 0;
+                for(int d=0; d<num_dims; d++){
+                    block_pos = block_pos * block_dims[b][d] + index[d] - block_offsets[b][d];
+                    region_pos = region_pos * (end[d] - begin[d]) + index[d] - begin[d];
+                }
+                memcpy(region_data + region_pos, block_data + block_pos, length * sizeof(T));
+                // next line
+                int d = num_dims - 2;
+                for(; d>=0; d--){
+                    if(++index[d] < hi[d]) break;
+                    index[d] = lo[d];
+                }
+                if(d < 0) break;
+            }
+        }
+
+        uint32_t serialized_size() const {
+            return sizeof(uint8_t) + get_size(dims) + get_size(grid) + num_blocks() * 2 * get_size(dims);
+        }
+
+        // num_dims, dims, grid, then offsets and dims of each block
+        void serialize(uint8_t *& buffer_pos) const {
+            *(buffer_pos ++) = (uint8_t) dims.size();
+            MDR::serialize(dims, buffer_pos);
+            MDR::serialize(grid, buffer_pos);
+            for(uint32_t b=0; b<num_blocks(); b++){
+                MDR::serialize(block_offsets[b], buffer_pos);
+                MDR::serialize(block_dims[b], buffer_pos);
+            }
+        }
+
+        void deserialize(uint8_t const *& buffer_pos){
+            uint8_t num_dims = *(buffer_pos ++);
+            MDR::deserialize(buffer_pos, num_dims, dims);
+            MDR::deserialize(buffer_pos, num_dims, grid);
+            uint32_t num_blocks = 1;
+            for(int d=0; d<num_dims; d++){
+                num_blocks *= grid[d];
+            }
+            block_offsets = std::vector<std::vector<uint32_t>>(num_blocks);
+            block_dims = std::vector<std::vector<uint32_t>>(num_blocks);
+            for(uint32_t b=0; b<num_blocks; b++){
+                MDR::deserialize(buffer_pos, num_dims, block_offsets[b]);
+                MDR::deserialize(buffer_pos, num_dims, block_dims[b]);
+            }
+        }
+
+        void print() const {
+            std::cout << "Block layout: " << num_blocks() << " blocks, grid = ";
+            print_vec(grid);
+        }
+
+        std::vector<uint32_t> dims;
+        std::vector<uint32_t> grid;
+        std::vector<std::vector<uint32_t>> block_offsets;
+        std::vector<std::vector<uint32_t>> block_dims;
+
+    private:
+        // visit the lines along the fastest dimension of block b as func(global position, block position, length)
+        template<class Func>
+        void for_each_line(uint32_t b, Func func) const {
+            const int num_dims = dims.size();
+            const std::vector<uint32_t>& extent = block_dims[b];
+            const size_t length = extent[num_dims - 1];
+            size_t num_lines = block_elements(b) / length;
+            std::vector<uint32_t> index(num_dims, 0);
+            for(size_t line=0; line<num_lines; line++){
+                size_t global_pos = 0;
+                for(int d=0; d<num_dims; d++){
+                    global_pos = global_pos * dims[d] + block_offsets[b][d] + index[d];
+                }
+                func(global_pos, line * length, length);
+                // next line
+                for(int d=num_dims-2; d>=0; d--){
+                    if(++index[d] < extent[d]) break;
+                    index[d] = 0;
+                }
+            }
+        }
+    };
+}
+#endif
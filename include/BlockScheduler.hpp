@@ -0,0 +1,142 @@
+#ifndef _MDR_BLOCK_SCHEDULER_HPP
+#define _MDR_BLOCK_SCHEDULER_HPP
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <numeric>
+#include <algorithm>
+#include <cstdint>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace MDR {
+    // work-stealing scheduler for independent block tasks of uneven cost
+    // tasks are dealt to per-thread queues (largest estimated cost first, each to the least loaded thread);
+    // a thread runs its own queue from the front and, once empty, steals the cheapest tasks from the back of the busiest queue
+    class BlockScheduler {
+    public:
+        BlockScheduler(int num_threads=1) {
+            set_num_threads(num_threads);
+        }
+
+        void set_num_threads(int n){
+            num_threads = (n > 0) ? n : 1;
+        }
+
+        int get_num_threads() const {
+            return num_threads;
+        }
+
+        // order of the tasks by decreasing cost; ties and missing costs keep the task order
+        static std::vector<uint32_t> order_by_cost(uint32_t num_tasks, const std::vector<double>& costs){
+            std::vector<uint32_t> order(num_tasks);
+            std::iota(order.begin(), order.end(), 0);
+            if(costs.size() == num_tasks){
+                std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){
+                    return costs[a] > costs[b];
+                });
+            }
+            return order;
+        }
+
+        // run func(task) for task in [0, num_tasks)
+        /*
+            @params num_tasks: number of tasks
+            @params costs: estimated cost of each task; empty for uniform cost
+            @params func: task body, must be safe to run concurrently for different tasks
+        */
+        template<class Func>
+        void run(uint32_t num_tasks, const std::vector<double>& costs, Func func) const {
+            const int n_workers = std::min<int>(num_threads, std::max<uint32_t>(num_tasks, 1));
+            if(n_workers == 1){
+                for(const auto& task:order_by_cost(num_tasks, costs)){
+                    func(task);
+                }
+                return;
+            }
+            std::vector<WorkQueue> queues(n_workers);
+            deal(num_tasks, costs, queues);
+            #pragma omp parallel num_threads(n_workers)
+            {
+                int id = 0;
+#ifdef _OPENMP
+                id = omp_get_thread_num();
+#endif
+                uint32_t task = 0;
+                while(queues[id].pop_front(task) || steal(queues, id, task)){
+                    func(task);
+                }
+            }
+        }
+    private:
+        struct WorkQueue {
+            std::deque<uint32_t> tasks;
+            double remaining_cost = 0;
+            std::vector<double> const * costs = NULL;
+            std::mutex mutex;
+
+            bool pop_front(uint32_t& task){
+                std::lock_guard<std::mutex> lock(mutex);
+                if(tasks.empty()) return false;
+                task = tasks.front();
+                tasks.pop_front();
+                remaining_cost -= cost(task);
+                return true;
+            }
+            bool pop_back(uint32_t& task){
+                std::lock_guard<std::mutex> lock(mutex);
+                if(tasks.empty()) return false;
+                task = tasks.back();
+                tasks.pop_back();
+                remaining_cost -= cost(task);
+                return true;
+            }
+            double load(){
+                std::lock_guard<std::mutex> lock(mutex);
+                return tasks.empty() ? -1 : remaining_cost;
+            }
+            double cost(uint32_t task) const {
+                return (costs->size() > task) ? (*costs)[task] : 1;
+            }
+        };
+
+        // longest-processing-time-first assignment to the least loaded queue
+        void deal(uint32_t num_tasks, const std::vector<double>& costs, std::vector<WorkQueue>& queues) const {
+            for(auto& q:queues){
+                q.costs = &costs;
+            }
+            for(const auto& task:order_by_cost(num_tasks, costs)){
+                int target = 0;
+                for(int i=1; i<queues.size(); i++){
+                    if(queues[i].remaining_cost < queues[target].remaining_cost) target = i;
+                }
+                queues[target].tasks.push_back(task);
+                queues[target].remaining_cost += queues[target].cost(task);
+            }
+        }
+
+        // take a task from the back of the queue with the most remaining work
+        static bool steal(std::vector<WorkQueue>& queues, int id, uint32_t& task){
+            while(true){
+                int victim = -1;
+                double max_load = -1;
+                for(int i=0; i<queues.size(); i++){
+                    if(i == id) continue;
+                    double load = queues[i].load();
+                    if(load > max_load){
+                        max_load = load;
+                        victim = i;
+                    }
+                }
+                if(victim < 0) return false;
+                if(queues[victim].pop_back(task)) return true;
+                // the victim drained meanwhile, look again
+            }
+        }
+
+        int num_threads = 1;
+    };
+}
+#endif
@@ -0,0 +1,118 @@
+#ifndef _MDR_CONTAINER_FORMAT_HPP
+#define _MDR_CONTAINER_FORMAT_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+namespace MDR {
+    // single-file container of the refactored data of all blocks:
+    //   header: u32 magic, u32 version, u32 layout
+    //   level and metadata segments of the blocks, each starting at a multiple of SEGMENT_ALIGNMENT
+    //   index: u32 num_blocks, then per block u64 metadata offset, u32 metadata size, u8 num_levels,
+    //          and per level u8 num_bitplanes, then u64 offset and u32 size of each bitplane
+    //   trailer: u64 index offset, u32 index size, u32 magic
+    enum ContainerLayout {
+        CONTAINER_BLOCK_MAJOR = 0,  // the bitplanes of a level of a block are stored back to back, as in a level file
+        CONTAINER_PLANE_MAJOR = 1,  // bitplane k of level l of all blocks is stored back to back, in block order
+    };
+
+    // bitplanes of one level of one block
+    struct ContainerLevelEntry {
+        std::vector<uint64_t> offsets;
+        std::vector<uint32_t> sizes;
+
+        uint64_t size() const {
+            uint64_t total = 0;
+            for(const auto& s:sizes){
+                total += s;
+            }
+            return total;
+        }
+    };
+
+    struct ContainerBlockEntry {
+        uint64_t metadata_offset = 0;
+        uint32_t metadata_size = 0;
+        std::vector<ContainerLevelEntry> levels;
+    };
+
+    // footer index of a container file
+    class ContainerIndex {
+    public:
+        static const uint32_t MAGIC = 0x4352444d;   // "MDRC"
+        static const uint32_t VERSION = 2;
+        static const size_t HEADER_SIZE = 3 * sizeof(uint32_t);
+        static const size_t TRAILER_SIZE = sizeof(uint64_t) + 2 * sizeof(uint32_t);
+        // segments start aligned, as they do at the beginning of separate level files
+        static const size_t SEGMENT_ALIGNMENT = 8;
+
+        size_t serialized_size() const {
+            size_t size = sizeof(uint32_t);
+            for(const auto& block:blocks){
+                size += sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint8_t);
+                for(const auto& level:block.levels){
+                    size += sizeof(uint8_t) + level.sizes.size() * (sizeof(uint64_t) + sizeof(uint32_t));
+                }
+            }
+            return size;
+        }
+
+        void serialize(uint8_t *& buffer_pos) const {
+            put<uint32_t>(blocks.size(), buffer_pos);
+            for(const auto& block:blocks){
+                put<uint64_t>(block.metadata_offset, buffer_pos);
+                put<uint32_t>(block.metadata_size, buffer_pos);
+                put<uint8_t>(block.levels.size(), buffer_pos);
+                for(const auto& level:block.levels){
+                    put<uint8_t>(level.sizes.size(), buffer_pos);
+                    for(int j=0; j<level.sizes.size(); j++){
+                        put<uint64_t>(level.offsets[j], buffer_pos);
+                        put<uint32_t>(level.sizes[j], buffer_pos);
+                    }
+                }
+            }
+        }
+
+        // returns false if the index is truncated
+        bool deserialize(uint8_t const *& buffer_pos, uint8_t const * buffer_end){
+            blocks.clear();
+            uint32_t num_blocks = 0;
+            if(!get(buffer_pos, buffer_end, num_blocks)) return false;
+            for(uint32_t b=0; b<num_blocks; b++){
+                ContainerBlockEntry block;
+                uint8_t num_levels = 0;
+                if(!get(buffer_pos, buffer_end, block.metadata_offset) || !get(buffer_pos, buffer_end, block.metadata_size) || !get(buffer_pos, buffer_end, num_levels)) return false;
+                block.levels.resize(num_levels);
+                for(auto& level:block.levels){
+                    uint8_t num_bitplanes = 0;
+                    if(!get(buffer_pos, buffer_end, num_bitplanes)) return false;
+                    level.offsets.resize(num_bitplanes);
+                    level.sizes.resize(num_bitplanes);
+                    for(int j=0; j<num_bitplanes; j++){
+                        if(!get(buffer_pos, buffer_end, level.offsets[j]) || !get(buffer_pos, buffer_end, level.sizes[j])) return false;
+                    }
+                }
+                blocks.push_back(block);
+            }
+            return true;
+        }
+
+        // values are stored unaligned in native byte order
+        template<class V>
+        static void put(V value, uint8_t *& buffer_pos){
+            memcpy(buffer_pos, &value, sizeof(V));
+            buffer_pos += sizeof(V);
+        }
+        template<class V>
+        static bool get(uint8_t const *& buffer_pos, uint8_t const * buffer_end, V& value){
+            if(buffer_pos + sizeof(V) > buffer_end) return false;
+            memcpy(&value, buffer_pos, sizeof(V));
+            buffer_pos += sizeof(V);
+            return true;
+        }
+
+        std::vector<ContainerBlockEntry> blocks;
+    };
+}
+#endif
@@ -2,6 +2,9 @@
 #define _MDR_DIRECT_INTERLEAVER_HPP
 
 #include "InterleaverInterface.hpp"
+#include <algorithm>
+#include <limits>
+#include <cstring>
 
 namespace MDR {
     // direct interleaver with in-order recording
@@ -46,6 +49,24 @@ namespace MDR {
                 exit(-1);
             }
         }
+        void interleave_range(T const * data, const std::vector<uint32_t>& dims, const std::vector<uint32_t>& dims_fine, const std::vector<uint32_t>& dims_coasre, size_t begin, size_t count, T * buffer, std::vector<uint32_t> strides=std::vector<uint32_t>()) const {
+            T * buffer_pos = buffer;
+            for_each_run(dims, dims_fine, dims_coasre, strides, begin, count, [&](size_t offset, size_t length){
+                memcpy(buffer_pos, data + offset, length * sizeof(T));
+                buffer_pos += length;
+            });
+        }
+        T max_abs_value(T const * data, const std::vector<uint32_t>& dims, const std::vector<uint32_t>& dims_fine, const std::vector<uint32_t>& dims_coasre, std::vector<uint32_t> strides=std::vector<uint32_t>()) const {
+            T max_val = 0;
+            for_each_run(dims, dims_fine, dims_coasre, strides, 0, std::numeric_limits<size_t>::max(), [&](size_t offset, size_t length){
+                T const * run = data + offset;
+                for(size_t i=0; i<length; i++){
+                    T val = fabs(run[i]);
+                    if(val > max_val) max_val = val;
+                }
+            });
+            return max_val;
+        }
         void reposition(T const * buffer, const std::vector<uint32_t>& dims, const std::vector<uint32_t>& dims_fine, const std::vector<uint32_t>& dims_coasre, T * data, std::vector<uint32_t> strides=std::vector<uint32_t>()) const {
             if(dims.size() == 1){
                 uint32_t count = 0;
@@ -86,6 +107,71 @@ namespace MDR {
         void print() const {
             std::cout << "Direct interleaver" << std::endl;
         }
+    private:
+        // visit the contiguous runs of elements [begin, begin + count) in interleaved order
+        // as func(offset in data, run length); 1D and 2D levels are viewed as 3D with leading unit dimensions
+        template<class Func>
+        void for_each_run(const std::vector<uint32_t>& dims, const std::vector<uint32_t>& dims_fine, const std::vector<uint32_t>& dims_coasre, const std::vector<uint32_t>& strides, size_t begin, size_t count, Func func) const {
+            if(dims.size() > 3){
+                std::cout << "Dimension higher than 4 is not supported\n";
+                exit(-1);
+            }
+            size_t fine[3] = {1, 1, 1};
+            size_t coarse[3] = {1, 1, 1};
+            size_t dim0_offset = 0;
+            size_t dim1_offset = 0;
+            const int shift = 3 - dims.size();
+            for(int d=0; d<dims.size(); d++){
+                fine[shift + d] = dims_fine[d];
+                coarse[shift + d] = dims_coasre[d];
+            }
+            if(dims.size() == 2){
+                dim1_offset = strides.size() ? strides[0] : dims[1];
+            }
+            else if(dims.size() == 3){
+                dim0_offset = strides.size() ? strides[0] : ((size_t) dims[1] * dims[2]);
+                dim1_offset = strides.size() ? strides[1] : dims[2];
+            }
+            // planes and lines crossing the coarse region skip its elements
+            const size_t plane_size = fine[1] * fine[2];
+            const size_t line_size = fine[2];
+            const size_t coarse_plane_size = plane_size - coarse[1] * coarse[2];
+            const size_t coarse_line_size = line_size - coarse[2];
+            // locate the begin-th element
+            size_t i = 0, j = 0, k = 0, rest = 0;
+            if(begin < coarse[0] * coarse_plane_size){
+                i = begin / coarse_plane_size;
+                rest = begin % coarse_plane_size;
+            }
+            else{
+                i = coarse[0] + (begin - coarse[0] * coarse_plane_size) / plane_size;
+                rest = (begin - coarse[0] * coarse_plane_size) % plane_size;
+            }
+            if((i < coarse[0]) && (rest < coarse[1] * coarse_line_size)){
+                j = rest / coarse_line_size;
+                k = coarse[2] + rest % coarse_line_size;
+            }
+            else if(i < coarse[0]){
+                j = coarse[1] + (rest - coarse[1] * coarse_line_size) / line_size;
+                k = (rest - coarse[1] * coarse_line_size) % line_size;
+            }
+            else{
+                j = rest / line_size;
+                k = rest % line_size;
+            }
+            // walk line by line
+            size_t remaining = count;
+            while(remaining && (i < fine[0])){
+                size_t length = std::min(line_size - k, remaining);
+                if(length) func(i * dim0_offset + j * dim1_offset + k, length);
+                remaining -= length;
+                if(++j == fine[1]){
+                    j = 0;
+                    i ++;
+                }
+                k = ((i < coarse[0]) && (j < coarse[1])) ? coarse[2] : 0;
+            }
+        }
     };
 }
 #endif
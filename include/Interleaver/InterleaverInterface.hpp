@@ -13,6 +13,12 @@ namespace MDR {
 
             virtual void interleave(T const * data, const std::vector<uint32_t>& dims, const std::vector<uint32_t>& dims_fine, const std::vector<uint32_t>& dims_coasre, T * buffer, std::vector<uint32_t> strides=std::vector<uint32_t>()) const = 0;
 
+            // interleave only elements [begin, begin + count) of the level into buffer
+            virtual void interleave_range(T const * data, const std::vector<uint32_t>& dims, const std::vector<uint32_t>& dims_fine, const std::vector<uint32_t>& dims_coasre, size_t begin, size_t count, T * buffer, std::vector<uint32_t> strides=std::vector<uint32_t>()) const = 0;
+
+            // max absolute value of the level coefficients, read in place
+            virtual T max_abs_value(T const * data, const std::vector<uint32_t>& dims, const std::vector<uint32_t>& dims_fine, const std::vector<uint32_t>& dims_coasre, std::vector<uint32_t> strides=std::vector<uint32_t>()) const = 0;
+
             virtual void reposition(T const * buffer, const std::vector<uint32_t>& dims, const std::vector<uint32_t>& dims_fine, const std::vector<uint32_t>& dims_coasre, T * data, std::vector<uint32_t> strides=std::vector<uint32_t>()) const = 0;
 
             virtual void print() const = 0;
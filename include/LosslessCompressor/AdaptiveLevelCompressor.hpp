@@ -9,17 +9,26 @@ namespace MDR {
     // compress all layers
     class AdaptiveLevelCompressor : public concepts::LevelCompressorInterface {
     public:
-        AdaptiveLevelCompressor(int l = 26) : latter_index(l) {}
-        uint8_t compress_level(std::vector<uint8_t*>& streams, std::vector<uint32_t>& stream_sizes) const {
+        AdaptiveLevelCompressor(int l = 26, int num_threads = 1, const ZSTD::Parameters& parameters = ZSTD::Parameters()) : latter_index(l), num_threads(num_threads), parameters(parameters) {}
+        // the decompressed buffers belong to one reconstruction and are not copied
+        AdaptiveLevelCompressor(const AdaptiveLevelCompressor& other) : latter_index(other.latter_index), num_threads(other.num_threads), parameters(other.parameters) {}
+        AdaptiveLevelCompressor& operator=(const AdaptiveLevelCompressor& other){
+            decompress_release();
+            latter_index = other.latter_index;
+            num_threads = other.num_threads;
+            parameters = other.parameters;
+            return *this;
+        }
+        uint8_t compress_level(std::vector<StreamBuffer>& streams, std::vector<uint32_t>& stream_sizes) const {
+            if(num_threads > 1) return compress_level_parallel(streams, stream_sizes);
             int stopping_index = stream_sizes.size();
             for(int i=0; i<streams.size(); i++){
-                uint8_t * compressed = NULL;
-                auto compressed_size = ZSTD::compress(streams[i], stream_sizes[i], &compressed);
-                free(streams[i]);
+                StreamBuffer compressed;
+                auto compressed_size = ZSTD::compress_pooled(streams[i].get(), stream_sizes[i], compressed, parameters);
                 // std::cout << compressed_size << " " << stream_sizes[i] << " " << stream_sizes[i] * 1.0 / compressed_size << std::endl;
                 // skip the first
                 float ratio = stream_sizes[i] * 1.0 / compressed_size;
-                streams[i] = compressed;
+                streams[i] = std::move(compressed);
                 stream_sizes[i] = compressed_size;
                 if(i && (ratio < CR_THRESHOLD)){
                     stopping_index = i;
@@ -28,29 +37,28 @@ namespace MDR {
             }
             int latter_start_index = (stopping_index < latter_index) ? latter_index : stopping_index + 1;
             for(int i=latter_start_index; i<streams.size(); i++){
-                uint8_t * compressed = NULL;
-                auto compressed_size = ZSTD::compress(streams[i], stream_sizes[i], &compressed);
-                free(streams[i]);
-                streams[i] = compressed;
+                StreamBuffer compressed;
+                auto compressed_size = ZSTD::compress_pooled(streams[i].get(), stream_sizes[i], compressed, parameters);
+                streams[i] = std::move(compressed);
                 stream_sizes[i] = compressed_size;
             }
             return stopping_index;
         }
         void decompress_level(std::vector<const uint8_t*>& streams, const std::vector<uint32_t>& stream_sizes, uint8_t starting_bitplane, uint8_t num_bitplanes, uint8_t stopping_index) {
-            for(int i=0; i<num_bitplanes; i++){
-                int bitplane_index = starting_bitplane + i;
-                if((bitplane_index <= stopping_index) || (bitplane_index >= latter_index)){
-                    uint8_t * decompressed = NULL;
-                    auto decompressed_size = ZSTD::decompress(streams[i], stream_sizes[bitplane_index], &decompressed);
-                    buffer.push_back(decompressed);
-                    streams[i] = decompressed;                    
-                }
+            std::vector<const uint8_t**> targets;
+            std::vector<uint32_t> sizes;
+            collect_compressed_bitplanes(streams, stream_sizes, starting_bitplane, num_bitplanes, stopping_index, targets, sizes);
+            decompress_bitplanes(targets, sizes);
+        }
+        void decompress_levels(std::vector<std::vector<const uint8_t*>>& level_streams, const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<uint8_t>& prev_level_num_bitplanes, const std::vector<uint8_t>& level_num_bitplanes, const std::vector<uint8_t>& stopping_indices) {
+            std::vector<const uint8_t**> targets;
+            std::vector<uint32_t> sizes;
+            for(int l=0; l<level_streams.size(); l++){
+                collect_compressed_bitplanes(level_streams[l], level_sizes[l], prev_level_num_bitplanes[l], level_num_bitplanes[l] - prev_level_num_bitplanes[l], stopping_indices[l], targets, sizes);
             }
+            decompress_bitplanes(targets, sizes);
         }
         void decompress_release(){
-            for(int i=0; i<buffer.size(); i++){
-                if(buffer[i]) free(buffer[i]);
-            }
             buffer.clear();
         }
         void print() const {
@@ -60,8 +68,72 @@ namespace MDR {
             decompress_release();
         }
     private:
+        // bitplanes in (stopping_index, latter_index) are stored without compression
+        void collect_compressed_bitplanes(std::vector<const uint8_t*>& streams, const std::vector<uint32_t>& stream_sizes, uint8_t starting_bitplane, uint8_t num_bitplanes, uint8_t stopping_index, std::vector<const uint8_t**>& targets, std::vector<uint32_t>& sizes) const {
+            for(int i=0; i<num_bitplanes; i++){
+                int bitplane_index = starting_bitplane + i;
+                if((bitplane_index <= stopping_index) || (bitplane_index >= latter_index)){
+                    targets.push_back(&streams[i]);
+                    sizes.push_back(stream_sizes[bitplane_index]);
+                }
+            }
+        }
+
+        // decompress into preallocated buffer slots so the result does not depend on thread timing
+        void decompress_bitplanes(const std::vector<const uint8_t**>& targets, const std::vector<uint32_t>& sizes){
+            const int offset = buffer.size();
+            buffer.resize(offset + targets.size());
+            #pragma omp parallel for schedule(dynamic) num_threads(num_threads) if(num_threads > 1)
+            for(int t=0; t<targets.size(); t++){
+                ZSTD::decompress_pooled(*targets[t], sizes[t], buffer[offset + t], parameters);
+                *targets[t] = buffer[offset + t].get();
+            }
+        }
+
+        // two-phase parallel compression producing the same streams and stopping index as the serial scan:
+        // 1) speculatively compress batches of num_threads bitplanes, then scan each batch in order for the stopping plane
+        // 2) compress the remaining latter bitplanes, and drop speculative results of bitplanes that stay uncompressed
+        uint8_t compress_level_parallel(std::vector<StreamBuffer>& streams, std::vector<uint32_t>& stream_sizes) const {
+            const int n = streams.size();
+            int stopping_index = n;
+            std::vector<StreamBuffer> compressed(n);
+            std::vector<uint32_t> compressed_sizes(n, 0);
+            for(int batch_start=0; (batch_start<n) && (stopping_index == n); batch_start+=num_threads){
+                int batch_end = std::min(batch_start + num_threads, n);
+                #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+                for(int i=batch_start; i<batch_end; i++){
+                    compressed_sizes[i] = ZSTD::compress_pooled(streams[i].get(), stream_sizes[i], compressed[i], parameters);
+                }
+                for(int i=batch_start; i<batch_end; i++){
+                    // skip the first
+                    float ratio = stream_sizes[i] * 1.0 / compressed_sizes[i];
+                    if(i && (ratio < CR_THRESHOLD)){
+                        stopping_index = i;
+                        break;
+                    }
+                }
+            }
+            int latter_start_index = (stopping_index < latter_index) ? latter_index : stopping_index + 1;
+            #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+            for(int i=latter_start_index; i<n; i++){
+                if(!compressed[i]){
+                    compressed_sizes[i] = ZSTD::compress_pooled(streams[i].get(), stream_sizes[i], compressed[i], parameters);
+                }
+            }
+            // speculative results of uncompressed bitplanes are dropped with compressed
+            for(int i=0; i<n; i++){
+                if((i <= stopping_index) || (i >= latter_start_index)){
+                    streams[i] = std::move(compressed[i]);
+                    stream_sizes[i] = compressed_sizes[i];
+                }
+            }
+            return stopping_index;
+        }
+
         int latter_index;
-        std::vector<uint8_t*> buffer;
+        int num_threads;
+        ZSTD::Parameters parameters;
+        std::vector<StreamBuffer> buffer;
     };
 }
 #endif
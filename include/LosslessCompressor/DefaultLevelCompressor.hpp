@@ -9,33 +9,51 @@ namespace MDR {
     // compress all layers
     class DefaultLevelCompressor : public concepts::LevelCompressorInterface {
     public:
-        DefaultLevelCompressor(){}
-        uint8_t compress_level(std::vector<uint8_t*>& streams, std::vector<uint32_t>& stream_sizes) const {
+        DefaultLevelCompressor(int num_threads = 1, const ZSTD::Parameters& parameters = ZSTD::Parameters()) : num_threads(num_threads), parameters(parameters) {}
+        // the decompressed buffers belong to one reconstruction and are not copied
+        DefaultLevelCompressor(const DefaultLevelCompressor& other) : num_threads(other.num_threads), parameters(other.parameters) {}
+        DefaultLevelCompressor& operator=(const DefaultLevelCompressor& other){
+            decompress_release();
+            num_threads = other.num_threads;
+            parameters = other.parameters;
+            return *this;
+        }
+        uint8_t compress_level(std::vector<StreamBuffer>& streams, std::vector<uint32_t>& stream_sizes) const {
             // Timer timer;
+            // bitplanes are compressed independently
+            #pragma omp parallel for schedule(dynamic) num_threads(num_threads) if(num_threads > 1)
             for(int i=0; i<streams.size(); i++){
-                uint8_t * compressed = NULL;
+                StreamBuffer compressed;
                 // timer.start();
-                auto compressed_size = ZSTD::compress(streams[i], stream_sizes[i], &compressed);
-                free(streams[i]);
+                auto compressed_size = ZSTD::compress_pooled(streams[i].get(), stream_sizes[i], compressed, parameters);
                 // timer.end();
-                streams[i] = compressed;
+                streams[i] = std::move(compressed);
                 stream_sizes[i] = compressed_size;
             }
             // timer.print("Lossless: ");
             return 0;
         }
         void decompress_level(std::vector<const uint8_t*>& streams, const std::vector<uint32_t>& stream_sizes, uint8_t starting_bitplane, uint8_t num_bitplanes, uint8_t stopping_index) {
+            std::vector<const uint8_t**> targets;
+            std::vector<uint32_t> sizes;
             for(int i=0; i<num_bitplanes; i++){
-                uint8_t * decompressed = NULL;
-                auto decompressed_size = ZSTD::decompress(streams[i], stream_sizes[starting_bitplane + i], &decompressed);
-                buffer.push_back(decompressed);
-                streams[i] = decompressed;
+                targets.push_back(&streams[i]);
+                sizes.push_back(stream_sizes[starting_bitplane + i]);
             }
+            decompress_bitplanes(targets, sizes);
         }
-        void decompress_release(){
-            for(int i=0; i<buffer.size(); i++){
-                free(buffer[i]);
+        void decompress_levels(std::vector<std::vector<const uint8_t*>>& level_streams, const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<uint8_t>& prev_level_num_bitplanes, const std::vector<uint8_t>& level_num_bitplanes, const std::vector<uint8_t>& stopping_indices) {
+            std::vector<const uint8_t**> targets;
+            std::vector<uint32_t> sizes;
+            for(int l=0; l<level_streams.size(); l++){
+                for(int i=0; i<level_num_bitplanes[l] - prev_level_num_bitplanes[l]; i++){
+                    targets.push_back(&level_streams[l][i]);
+                    sizes.push_back(level_sizes[l][prev_level_num_bitplanes[l] + i]);
+                }
             }
+            decompress_bitplanes(targets, sizes);
+        }
+        void decompress_release(){
             buffer.clear();
         }
         void print() const {
@@ -45,7 +63,20 @@ namespace MDR {
             decompress_release();
         }
     private:
-        std::vector<uint8_t*> buffer;
+        // decompress into preallocated buffer slots so the result does not depend on thread timing
+        void decompress_bitplanes(const std::vector<const uint8_t**>& targets, const std::vector<uint32_t>& sizes){
+            const int offset = buffer.size();
+            buffer.resize(offset + targets.size());
+            #pragma omp parallel for schedule(dynamic) num_threads(num_threads) if(num_threads > 1)
+            for(int t=0; t<targets.size(); t++){
+                ZSTD::decompress_pooled(*targets[t], sizes[t], buffer[offset + t], parameters);
+                *targets[t] = buffer[offset + t].get();
+            }
+        }
+
+        int num_threads;
+        ZSTD::Parameters parameters;
+        std::vector<StreamBuffer> buffer;
     };
 }
 #endif
@@ -1,6 +1,8 @@
 #ifndef _MDR_LEVEL_COMPRESSOR_INTERFACE_HPP
 #define _MDR_LEVEL_COMPRESSOR_INTERFACE_HPP
 
+#include "StreamPool.hpp"
+
 namespace MDR {
     namespace concepts {
 
@@ -10,12 +12,15 @@ namespace MDR {
 
             virtual ~LevelCompressorInterface() = default;
 
-            // compress level, overwrite and free original streams; rewrite streams sizes
-            virtual uint8_t compress_level(std::vector<uint8_t*>& streams, std::vector<uint32_t>& stream_sizes) const = 0;
+            // compress level, replace the original streams; rewrite streams sizes
+            virtual uint8_t compress_level(std::vector<StreamBuffer>& streams, std::vector<uint32_t>& stream_sizes) const = 0;
 
             // decompress level, create new buffer and overwrite original streams; will not change stream sizes
             virtual void decompress_level(std::vector<const uint8_t*>& streams, const std::vector<uint32_t>& stream_sizes, uint8_t starting_bitplane, uint8_t num_bitplanes, uint8_t stopping_index) = 0;
 
+            // decompress the newly retrieved bitplanes of all levels at once; same buffer semantics as decompress_level
+            virtual void decompress_levels(std::vector<std::vector<const uint8_t*>>& level_streams, const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<uint8_t>& prev_level_num_bitplanes, const std::vector<uint8_t>& level_num_bitplanes, const std::vector<uint8_t>& stopping_indices) = 0;
+
             // release the buffer created
             virtual void decompress_release() = 0;
 
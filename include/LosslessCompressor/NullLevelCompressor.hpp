@@ -8,8 +8,9 @@ namespace MDR {
     class NullLevelCompressor : public concepts::LevelCompressorInterface {
     public:
         NullLevelCompressor(){}
-        uint8_t compress_level(std::vector<uint8_t*>& streams, std::vector<uint32_t>& stream_sizes) const { return 0;}
+        uint8_t compress_level(std::vector<StreamBuffer>& streams, std::vector<uint32_t>& stream_sizes) const { return 0;}
         void decompress_level(std::vector<const uint8_t*>& streams, const std::vector<uint32_t>& stream_sizes, uint8_t starting_bitplane, uint8_t num_bitplanes, uint8_t stopping_index){}
+        void decompress_levels(std::vector<std::vector<const uint8_t*>>& level_streams, const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<uint8_t>& prev_level_num_bitplanes, const std::vector<uint8_t>& level_num_bitplanes, const std::vector<uint8_t>& stopping_indices){}
         void decompress_release(){}
         void print() const {
             std::cout << "Null level compressor" << std::endl;
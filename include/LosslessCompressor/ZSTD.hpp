@@ -1,29 +1,135 @@
 #ifndef _MDR_ZSTD_HPP
 #define _MDR_ZSTD_HPP
 
+#include <cstring>
 #include "zstd.h"
+#include "StreamPool.hpp"
 
 namespace MDR {
     namespace ZSTD{
         #define ZSTD_LEVEL 3 //default setting of level is 3
-        // ZSTD lossless compressor
-        uint32_t compress(const uint8_t* data, uint32_t dataLength, uint8_t** compressBytes) {
-            uint32_t outSize = 0; 
-            size_t estimatedCompressedSize = 0;
-            if(dataLength < 1024) 
-                estimatedCompressedSize = 2048;
-            else
-                estimatedCompressedSize = (dataLength*1.2)/8 * 8;
-            *compressBytes = (uint8_t*)malloc(estimatedCompressedSize);
-            *reinterpret_cast<size_t*>(*compressBytes) = dataLength;
-            outSize = ZSTD_compress(*compressBytes + sizeof(size_t), estimatedCompressedSize, data, dataLength, ZSTD_LEVEL); 
+        // compression parameters; window_log = 0 keeps the ZSTD default window
+        struct Parameters{
+            int compression_level;
+            int window_log;
+            Parameters(int compression_level = ZSTD_LEVEL, int window_log = 0) : compression_level(compression_level), window_log(window_log) {}
+        };
+        // ZSTD contexts owned by the calling thread, created on first use and reused by all later calls
+        class ThreadContext{
+        public:
+            static ThreadContext& get(){
+                static thread_local ThreadContext context;
+                return context;
+            }
+            ZSTD_CCtx * compression_context(const Parameters& parameters){
+                if(cctx == NULL) cctx = ZSTD_createCCtx();
+#if ZSTD_VERSION_NUMBER >= 10400
+                // parameters are sticky in the context, only reset them when they change
+                if(!cctx_configured || (parameters.compression_level != cctx_parameters.compression_level) || (parameters.window_log != cctx_parameters.window_log)){
+                    ZSTD_CCtx_reset(cctx, ZSTD_reset_parameters);
+                    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, parameters.compression_level);
+                    if(parameters.window_log) ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, parameters.window_log);
+                    cctx_parameters = parameters;
+                    cctx_configured = true;
+                }
+#endif
+                return cctx;
+            }
+            ZSTD_DCtx * decompression_context(const Parameters& parameters){
+                if(dctx == NULL) dctx = ZSTD_createDCtx();
+#if ZSTD_VERSION_NUMBER >= 10400
+                // frames with a window larger than the default limit need windowLogMax raised
+                if(parameters.window_log != dctx_window_log){
+                    ZSTD_DCtx_reset(dctx, ZSTD_reset_parameters);
+                    if(parameters.window_log) ZSTD_DCtx_setParameter(dctx, ZSTD_d_windowLogMax, parameters.window_log);
+                    dctx_window_log = parameters.window_log;
+                }
+#endif
+                return dctx;
+            }
+            ~ThreadContext(){
+                if(cctx) ZSTD_freeCCtx(cctx);
+                if(dctx) ZSTD_freeDCtx(dctx);
+            }
+        private:
+            ThreadContext(){}
+            ThreadContext(const ThreadContext&) = delete;
+            ThreadContext& operator=(const ThreadContext&) = delete;
+            ZSTD_CCtx * cctx = NULL;
+            ZSTD_DCtx * dctx = NULL;
+            Parameters cctx_parameters;
+            bool cctx_configured = false;
+            int dctx_window_log = 0;
+        };
+        // capacity needed to compress dataLength bytes, including the size header
+        uint32_t compress_bound(uint32_t dataLength){
+            return ZSTD_compressBound(dataLength) + sizeof(size_t);
+        }
+        // ZSTD lossless compressor writing into a caller-provided buffer; returns 0 on failure
+        uint32_t compress(const uint8_t* data, uint32_t dataLength, uint8_t* compressBytes, uint32_t capacity, const Parameters& parameters = Parameters()) {
+            *reinterpret_cast<size_t*>(compressBytes) = dataLength;
+            ZSTD_CCtx * cctx = ThreadContext::get().compression_context(parameters);
+#if ZSTD_VERSION_NUMBER >= 10400
+            size_t outSize = ZSTD_compress2(cctx, compressBytes + sizeof(size_t), capacity - sizeof(size_t), data, dataLength);
+#else
+            size_t outSize = ZSTD_compressCCtx(cctx, compressBytes + sizeof(size_t), capacity - sizeof(size_t), data, dataLength, parameters.compression_level);
+#endif
+            if(ZSTD_isError(outSize)){
+                std::cerr << "ZSTD compression error: " << ZSTD_getErrorName(outSize) << std::endl;
+                return 0;
+            }
             return outSize + sizeof(size_t);
         }
-        uint32_t decompress(const uint8_t* compressBytes, uint32_t cmpSize, uint8_t** oriData) {
-            uint32_t outSize = 0;
-            outSize = *reinterpret_cast<const size_t*>(compressBytes);
+        // ZSTD lossless compressor; the returned buffer is shrunk to the compressed size
+        uint32_t compress(const uint8_t* data, uint32_t dataLength, uint8_t** compressBytes, const Parameters& parameters = Parameters()) {
+            uint32_t capacity = compress_bound(dataLength);
+            *compressBytes = (uint8_t*)malloc(capacity);
+            uint32_t outSize = compress(data, dataLength, *compressBytes, capacity, parameters);
+            if(outSize){
+                uint8_t * shrunk = (uint8_t*)realloc(*compressBytes, outSize);
+                if(shrunk) *compressBytes = shrunk;
+            }
+            return outSize;
+        }
+        // size of the original data recorded in the header
+        uint32_t decompressed_size(const uint8_t* compressBytes) {
+            return *reinterpret_cast<const size_t*>(compressBytes);
+        }
+        // ZSTD decompression into a caller-provided buffer of at least decompressed_size() bytes
+        uint32_t decompress(const uint8_t* compressBytes, uint32_t cmpSize, uint8_t* oriData, uint32_t capacity, const Parameters& parameters = Parameters()) {
+            uint32_t outSize = decompressed_size(compressBytes);
+            ZSTD_DCtx * dctx = ThreadContext::get().decompression_context(parameters);
+            size_t err = ZSTD_decompressDCtx(dctx, oriData, capacity, compressBytes + sizeof(size_t), cmpSize - sizeof(size_t));
+            if(ZSTD_isError(err)){
+                std::cerr << "ZSTD decompression error: " << ZSTD_getErrorName(err) << std::endl;
+                return 0;
+            }
+            return outSize;
+        }
+        uint32_t decompress(const uint8_t* compressBytes, uint32_t cmpSize, uint8_t** oriData, const Parameters& parameters = Parameters()) {
+            uint32_t outSize = decompressed_size(compressBytes);
             *oriData = (uint8_t*)malloc(outSize);
-            ZSTD_decompress(*oriData, outSize, compressBytes + sizeof(size_t), cmpSize - sizeof(size_t));
+            decompress(compressBytes, cmpSize, *oriData, outSize, parameters);
+            return outSize;
+        }
+        // compress into a StreamPool buffer; the result is moved to a smaller size class when one fits,
+        // and the worst-case buffer goes back to the pool for the next stream
+        uint32_t compress_pooled(const uint8_t* data, uint32_t dataLength, StreamBuffer& compressBytes, const Parameters& parameters = Parameters()) {
+            uint32_t capacity = compress_bound(dataLength);
+            StreamBuffer bound_buffer(capacity);
+            uint32_t outSize = compress(data, dataLength, bound_buffer.get(), capacity, parameters);
+            if(outSize && (outSize + outSize / 4 < StreamPool::capacity(bound_buffer.get()))){
+                compressBytes = StreamBuffer(outSize);
+                memcpy(compressBytes.get(), bound_buffer.get(), outSize);
+            }
+            else compressBytes = std::move(bound_buffer);
+            return outSize;
+        }
+        // decompress into a StreamPool buffer
+        uint32_t decompress_pooled(const uint8_t* compressBytes, uint32_t cmpSize, StreamBuffer& oriData, const Parameters& parameters = Parameters()) {
+            uint32_t outSize = decompressed_size(compressBytes);
+            oriData = StreamBuffer(outSize);
+            decompress(compressBytes, cmpSize, oriData.get(), outSize, parameters);
             return outSize;
         }
     }
@@ -1,6 +1,8 @@
 #ifndef _MDR_COMPOSED_RECONSTRUCTOR_HPP
 #define _MDR_COMPOSED_RECONSTRUCTOR_HPP
 
+#include <algorithm>
+#include <type_traits>
 #include "BitplaneEncoder/BitplaneEncoder.hpp"
 #include "Decomposer/Decomposer.hpp"
 #include "ErrorCollector/ErrorCollector.hpp"
@@ -60,13 +62,21 @@ public:
 
     // timer.start();
     auto prev_level_num_bitplanes(level_num_bitplanes);
+    // levels are read one by one while reconstructing, see set_pipelined
+    const bool pipeline =
+        pipelined &&
+        std::is_base_of<concepts::LevelRetrieverInterface, Retriever>::value;
     if (max_level == -1 || (max_level >= level_num_bitplanes.size())) {
       auto retrieve_sizes = interpreter.interpret_retrieve_size(
           level_sizes, level_errors, tolerance, level_num_bitplanes);
       // retrieve data
-      level_components = retriever.retrieve_level_components(
-          level_sizes, retrieve_sizes, prev_level_num_bitplanes,
-          level_num_bitplanes);
+      if (pipeline)
+        level_components.assign(level_num_bitplanes.size(),
+                                std::vector<const uint8_t *>());
+      else
+        level_components = retriever.retrieve_level_components(
+            level_sizes, retrieve_sizes, prev_level_num_bitplanes,
+            level_num_bitplanes);
       // Modified to collect retrieved size
       this->lastRetrieveSizes = retrieve_sizes;
     } else {
@@ -81,16 +91,23 @@ public:
       auto retrieve_sizes = interpreter.interpret_retrieve_size(
           tmp_level_sizes, tmp_level_errors, tolerance,
           tmp_level_num_bitplanes);
-      level_components = retriever.retrieve_level_components(
-          tmp_level_sizes, retrieve_sizes, prev_level_num_bitplanes,
-          tmp_level_num_bitplanes);
+      if (!pipeline)
+        level_components = retriever.retrieve_level_components(
+            tmp_level_sizes, retrieve_sizes, prev_level_num_bitplanes,
+            tmp_level_num_bitplanes);
       // add level_num_bitplanes
       for (int i = 0; i <= max_level; i++) {
         level_num_bitplanes[i] = tmp_level_num_bitplanes[i];
       }
+      // no new bitplanes from the finer levels
+      level_components.resize(level_num_bitplanes.size());
       // Modified to collect retrieved size
       this->lastRetrieveSizes = retrieve_sizes;
     }
+    // read the next step while this one is decoded
+    prefetch_next(tolerance, level_errors,
+                  std::is_base_of<concepts::PrefetchRetrieverInterface,
+                                  Retriever>());
     // check whether to reconstruct to full resolution
     int skipped_level = 0;
     for (int i = 0; i <= target_level; i++) {
@@ -99,15 +116,23 @@ public:
         break;
       }
     }
-    // TODO: uncomment skip level to reconstruct low resolution data
-    // target_level -= skipped_level;
     // timer.end();
     // timer.print("Interpret and retrieval");
-    int reconstruct_level = target_level - skipped_level;
+    // finer levels without bitplanes only contribute zero coefficients, the
+    // low resolution mode stops before them or at the level asked for
+    int reconstruct_level = target_level;
+    if (low_resolution) {
+      reconstruct_level = ((max_level >= 0) && (max_level < target_level))
+                              ? max_level
+                              : target_level - skipped_level;
+      // the resolution of the progressive state never decreases
+      reconstruct_level = std::max(reconstruct_level, current_level);
+    }
     // std::cout << "skipped_level = " << skipped_level << ", target_level = "
     // << +target_level << std::endl;
 
-    bool success = reconstruct(reconstruct_level, prev_level_num_bitplanes);
+    bool success =
+        reconstruct(reconstruct_level, prev_level_num_bitplanes, pipeline);
     retriever.release();
     if (success) {
       current_level = reconstruct_level;
@@ -123,35 +148,37 @@ public:
   }
   // reconstruct progressively based on available data
   T *progressive_reconstruct(double tolerance, int max_level = -1) {
-    // std::vector<T> cur_data(data);
     reconstruct(tolerance, max_level);
-    // TODO: add resolution changes
-    // if(cur_data.size() == data.size()){
-    //     for(int i=0; i<data.size(); i++){
-    //         data[i] += cur_data[i];
-    //     }
-    // }
-    // else if(cur_data.size()){
-    //     std::cerr << "Reconstruct size changes, not supported yet." <<
-    //     std::endl; std::cerr << "Sizes before reconstruction: " <<
-    //     cur_data.size() << std::endl; std::cerr << "Sizes after
-    //     reconstruction: " << data.size() << std::endl; exit(0);
-    // }
     return data.data();
   }
-  // TODO: do not overwrite
+  // recompose a low resolution reconstruction to full resolution with zero
+  // finer coefficients; the result is kept apart from the progressive state
   T *recompose_to_full() {
-    clear_data(data.data(), current_dimensions, dimensions, dimensions);
     int target_level = level_num.size() - 1;
+    if (current_level == target_level)
+      return data.data();
     std::cout << "recompose to full for " << target_level - current_level
               << " levels!\n";
-    std::cout << "dimensions: " << dimensions[0] << " " << dimensions[1] << " "
-              << dimensions[2] << "\n";
-    decomposer.recompose(data.data(), dimensions, target_level - current_level,
-                         this->strides);
-    return data.data();
+    size_t num_elements = 1;
+    for (const auto &d : dimensions)
+      num_elements *= d;
+    full_data.assign(num_elements, 0);
+    if (current_level >= 0) {
+      memcpy(full_data.data(), data.data(), data.size() * sizeof(T));
+      expand(full_data.data(), current_dimensions, dimensions);
+      decomposer.recompose(full_data.data(), dimensions,
+                           target_level - current_level,
+                           std::vector<uint32_t>());
+    }
+    return full_data.data();
   }
 
+  // reconstruct to the finest level with retrieved bitplanes only, or to the
+  // max_level of progressive_reconstruct; the returned array is compact in
+  // get_current_dimensions(). Off by default: every step is reconstructed to
+  // target_level at full resolution
+  void set_low_resolution(bool enable) { low_resolution = enable; }
+
   void load_metadata() {
     uint8_t *metadata = retriever.load_metadata();
     uint8_t const *metadata_pos = metadata;
@@ -164,13 +191,10 @@ public:
     deserialize(metadata_pos, num_levels, stopping_indices);
     deserialize(metadata_pos, num_levels, level_num);
     level_num_bitplanes = std::vector<uint8_t>(num_levels, 0);
-    strides = std::vector<uint32_t>(dimensions.size());
-    uint32_t stride = 1;
-    for (int i = dimensions.size() - 1; i >= 0; i--) {
-      strides[i] = stride;
-      stride *= dimensions[i];
-    }
-    data = std::vector<T>(stride, 0);
+    // allocated at the resolution of the first reconstruction
+    data.clear();
+    current_dimensions.clear();
+    current_level = -1;
     free(metadata);
   }
 
@@ -182,6 +206,11 @@ public:
 
   int get_reconstruct_level() { return current_level; }
 
+  // sizes of the stored bitplanes of each level
+  const std::vector<std::vector<uint32_t>> &get_level_sizes() const {
+    return level_sizes;
+  }
+
   ~ComposedReconstructor() {}
 
   void print() const {
@@ -199,6 +228,22 @@ public:
     retriever.print();
   }
 
+  // tolerance of the next step, whose bitplanes are prefetched during the
+  // current one if the retriever supports it (see PrefetchRetriever)
+  void prefetch_tolerance(double tolerance) { next_tolerance = tolerance; }
+
+  // predict the next tolerance as ratio times the current one when none is
+  // given by prefetch_tolerance, 0 to disable
+  void set_prefetch_ratio(double ratio) { prefetch_ratio = ratio; }
+
+  // overlap reading and decompressing each level with decoding and
+  // repositioning the previous one; needs a retriever that reads single
+  // levels (concepts::LevelRetrieverInterface)
+  void set_pipelined(bool enable) { pipelined = enable; }
+
+  // number of threads merging the progressive updates
+  void set_num_threads(int n) { num_threads = (n > 0) ? n : 1; }
+
   const std::vector<uint32_t> &getLastRetrieveSizes() const {
     return lastRetrieveSizes;
   }
@@ -206,7 +251,7 @@ public:
 private:
   bool reconstruct(uint8_t target_level,
                    const std::vector<uint8_t> &prev_level_num_bitplanes,
-                   bool progressive = true) {
+                   bool pipeline) {
     auto num_levels = level_num.size();
     auto level_dims = compute_level_dims(dimensions, num_levels - 1);
     auto reconstruct_dimensions = level_dims[target_level];
@@ -214,109 +259,212 @@ private:
     //           << ", dims = " << reconstruct_dimensions[0] << " "
     //           << reconstruct_dimensions[1] << " " << reconstruct_dimensions[2]
     //           << std::endl;
-    // update with stride
-    std::vector<T> cur_data(data);
-    memset(data.data(), 0, data.size() * sizeof(T));
-
-    // std::cout << "current_level = " << current_level << std::endl;
     auto level_elements = compute_level_elements(level_dims, target_level);
     std::vector<uint32_t> dims_dummy(reconstruct_dimensions.size(), 0);
+    // data holds the recomposition of the previous bitplanes; by linearity,
+    // only the new bitplanes of the levels up to current_level are decoded into
+    // a compact delta over current_dimensions, recomposed and added to data
+    bool has_delta = false;
     for (int i = 0; i <= current_level; i++) {
-      if (level_num_bitplanes[i] - prev_level_num_bitplanes[i] > 0) {
-        compressor.decompress_level(
-            level_components[i], level_sizes[i], prev_level_num_bitplanes[i],
-            level_num_bitplanes[i] - prev_level_num_bitplanes[i],
-            stopping_indices[i]);
-        int level_exp = 0;
-        frexp(level_error_bounds[i], &level_exp);
-        auto level_decoded_data = encoder.progressive_decode(
-            level_components[i], level_elements[i], level_exp,
-            prev_level_num_bitplanes[i],
-            level_num_bitplanes[i] - prev_level_num_bitplanes[i], i);
-        compressor.decompress_release();
-        const std::vector<uint32_t> &prev_dims =
-            (i == 0) ? dims_dummy : level_dims[i - 1];
-        interleaver.reposition(level_decoded_data, reconstruct_dimensions,
-                               level_dims[i], prev_dims, data.data(),
-                               this->strides);
-        free(level_decoded_data);
-      }
+      if (level_num_bitplanes[i] - prev_level_num_bitplanes[i] > 0)
+        has_delta = true;
     }
-    // decompose data to current level
-    if (current_level >= 0) {
-      if (current_level)
-        decomposer.recompose(data.data(), current_dimensions, current_level,
-                             this->strides);
-      // std::cout << "update data\n";
-      // update data with strides
-      if (dimensions.size() == 1) {
-        for (int i = 0; i < current_dimensions[0]; i++) {
-          data[i] += cur_data[i];
-        }
-      } else if (dimensions.size() == 2) {
-        for (int i = 0; i < current_dimensions[0]; i++) {
-          for (int j = 0; j < current_dimensions[1]; j++) {
-            data[i * this->strides[0] + j] +=
-                cur_data[i * this->strides[0] + j];
-          }
-        }
-      } else if (dimensions.size() == 3) {
-        for (int i = 0; i < current_dimensions[0]; i++) {
-          for (int j = 0; j < current_dimensions[1]; j++) {
-            for (int k = 0; k < current_dimensions[2]; k++) {
-              data[i * this->strides[0] + j * this->strides[1] + k] +=
-                  cur_data[i * this->strides[0] + j * this->strides[1] + k];
-            }
-          }
-        }
-      }
+    if (has_delta) {
+      size_t num_elements = 1;
+      for (const auto &d : current_dimensions)
+        num_elements *= d;
+      delta.assign(num_elements, 0);
     }
-    // std::cout << "decompose to target_level\n";
-    // decompose data to target level
-    for (int i = current_level + 1; i <= target_level; i++) {
-      compressor.decompress_level(
-          level_components[i], level_sizes[i], prev_level_num_bitplanes[i],
-          level_num_bitplanes[i] - prev_level_num_bitplanes[i],
-          stopping_indices[i]);
+    // decode the new bitplanes of level i into delta, or into data for the
+    // finer levels, which are decoded in full and overwrite their coefficients
+    auto decode_level = [&](int i) {
       int level_exp = 0;
       frexp(level_error_bounds[i], &level_exp);
       auto level_decoded_data = encoder.progressive_decode(
           level_components[i], level_elements[i], level_exp,
           prev_level_num_bitplanes[i],
           level_num_bitplanes[i] - prev_level_num_bitplanes[i], i);
-      compressor.decompress_release();
       const std::vector<uint32_t> &prev_dims =
           (i == 0) ? dims_dummy : level_dims[i - 1];
-      interleaver.reposition(level_decoded_data, reconstruct_dimensions,
-                             level_dims[i], prev_dims, data.data(),
-                             this->strides);
+      if (i <= current_level)
+        interleaver.reposition(level_decoded_data, current_dimensions,
+                               level_dims[i], prev_dims, delta.data());
+      else
+        interleaver.reposition(level_decoded_data, reconstruct_dimensions,
+                               level_dims[i], prev_dims, data.data());
       free(level_decoded_data);
+    };
+    // once the levels up to current_level are decoded, add their update and
+    // lay data out in the reconstructed dimensions for the finer levels
+    auto update_data = [&]() {
+      if (has_delta) {
+        if (current_level)
+          decomposer.recompose(delta.data(), current_dimensions, current_level,
+                               std::vector<uint32_t>());
+        accumulate(delta.data(), delta.size(), data.data());
+      }
+      // data is compact in the reconstructed dimensions
+      size_t num_elements = 1;
+      for (const auto &d : reconstruct_dimensions)
+        num_elements *= d;
+      if (current_level < 0) {
+        data.assign(num_elements, 0);
+      } else if (num_elements != data.size()) {
+        data.resize(num_elements);
+        expand(data.data(), current_dimensions, reconstruct_dimensions);
+      }
+    };
+    if (pipeline) {
+      reconstruct_pipelined(target_level, prev_level_num_bitplanes,
+                            decode_level, update_data);
+    } else {
+      // decompress the new bitplanes of all levels in one parallel pass
+      compressor.decompress_levels(level_components, level_sizes,
+                                   prev_level_num_bitplanes,
+                                   level_num_bitplanes, stopping_indices);
+      for (int i = 0; i <= current_level; i++) {
+        if (level_num_bitplanes[i] - prev_level_num_bitplanes[i] > 0)
+          decode_level(i);
+      }
+      update_data();
+      for (int i = current_level + 1; i <= target_level; i++) {
+        decode_level(i);
+      }
     }
+    compressor.decompress_release();
     if (current_level >= 0) {
-      decomposer.recompose(data.data(), reconstruct_dimensions,
-                           target_level - current_level, this->strides);
+      if (target_level > current_level)
+        decomposer.recompose(data.data(), reconstruct_dimensions,
+                             target_level - current_level,
+                             std::vector<uint32_t>());
     } else {
       decomposer.recompose(data.data(), reconstruct_dimensions, target_level,
-                           this->strides);
+                           std::vector<uint32_t>());
     }
     current_dimensions = reconstruct_dimensions;
     return true;
   }
 
-  void clear_data(T *dst, const std::vector<uint32_t> &coarse_dims,
-                  const std::vector<uint32_t> &fine_dims,
-                  const std::vector<uint32_t> &dims) {
-    for (int i = 0; i < fine_dims[0]; i++) {
-      for (int j = 0; j < fine_dims[1]; j++) {
-        for (int k = 0; k < fine_dims[2]; k++) {
-          if ((i < coarse_dims[0]) && (j < coarse_dims[1]) &&
-              (k < coarse_dims[2])) {
-
-          } else {
-            dst[i * dims[1] * dims[2] + j * dims[2] + k] = 0;
+  // two-stage pipeline over the levels as OpenMP tasks: one thread reads and
+  // decompresses the levels in order while the other decodes them in the same
+  // order, so that level i + 1 is fetched during the decoding of level i
+  template <class DecodeLevel, class UpdateData>
+  void
+  reconstruct_pipelined(uint8_t target_level,
+                        const std::vector<uint8_t> &prev_level_num_bitplanes,
+                        DecodeLevel &decode_level, UpdateData &update_data) {
+    std::vector<char> fetched(target_level + 1);
+    char *level_fetched = fetched.data();
+    // tokens keeping each stage in level order
+    char fetch_stage = 0, decode_stage = 0;
+#pragma omp parallel num_threads(2)
+#pragma omp single
+    {
+      for (int i = 0; i <= target_level; i++) {
+        const uint8_t num_bitplanes =
+            level_num_bitplanes[i] - prev_level_num_bitplanes[i];
+        // the reads are reported here as the tasks would interleave them
+        print_retrieve(i, prev_level_num_bitplanes[i], level_num_bitplanes[i]);
+        if (i == current_level + 1) {
+#pragma omp task depend(inout : decode_stage)
+          update_data();
+        }
+        if ((i <= current_level) && (num_bitplanes == 0))
+          continue;
+        if (num_bitplanes > 0) {
+#pragma omp task depend(inout : fetch_stage) depend(out : level_fetched[i])
+          {
+            const bool logging = retrieve_logging();
+            retrieve_logging() = false;
+            level_components[i] = retrieve_level(
+                i, lastRetrieveSizes[i], prev_level_num_bitplanes[i],
+                std::is_base_of<concepts::LevelRetrieverInterface,
+                                Retriever>());
+            retrieve_logging() = logging;
+            compressor.decompress_level(level_components[i], level_sizes[i],
+                                        prev_level_num_bitplanes[i],
+                                        num_bitplanes, stopping_indices[i]);
           }
         }
+#pragma omp task depend(inout : decode_stage) depend(in : level_fetched[i])
+        decode_level(i);
+      }
+      if (current_level >= target_level) {
+#pragma omp task depend(inout : decode_stage)
+        update_data();
+      }
+    }
+    print_total_retrieve_size(level_sizes, lastRetrieveSizes,
+                              prev_level_num_bitplanes);
+  }
+  std::vector<const uint8_t *> retrieve_level(int i, uint32_t retrieve_size,
+                                              uint8_t prev_num_bitplanes,
+                                              std::true_type) {
+    return retriever.retrieve_level(i, level_sizes[i], retrieve_size,
+                                    prev_num_bitplanes, level_num_bitplanes[i]);
+  }
+  std::vector<const uint8_t *> retrieve_level(int i, uint32_t retrieve_size,
+                                              uint8_t prev_num_bitplanes,
+                                              std::false_type) {
+    return std::vector<const uint8_t *>();
+  }
+
+  void prefetch_next(double tolerance,
+                     const std::vector<std::vector<double>> &level_errors,
+                     std::true_type) {
+    double tolerance_ahead =
+        (next_tolerance > 0) ? next_tolerance : tolerance * prefetch_ratio;
+    next_tolerance = 0;
+    if (!(tolerance_ahead > 0) || (tolerance_ahead >= tolerance))
+      return;
+    auto next_level_num_bitplanes(level_num_bitplanes);
+    auto retrieve_sizes = interpreter.interpret_retrieve_size(
+        level_sizes, level_errors, tolerance_ahead, next_level_num_bitplanes);
+    if (next_level_num_bitplanes != level_num_bitplanes)
+      retriever.prefetch(level_sizes, retrieve_sizes, level_num_bitplanes,
+                         next_level_num_bitplanes);
+  }
+  void prefetch_next(double tolerance,
+                     const std::vector<std::vector<double>> &level_errors,
+                     std::false_type) {}
+
+  // add src to dst element-wise
+  void accumulate(T const *src, size_t n, T *dst) {
+    const int64_t num_elements = n;
+#pragma omp parallel for simd num_threads(num_threads) if (num_threads > 1)
+    for (int64_t i = 0; i < num_elements; i++) {
+      dst[i] += src[i];
+    }
+  }
+
+  // move the compact coarse box at the front of data, which holds the fine box
+  // and zeros beyond the coarse one, to its place in the compact fine box;
+  // rows are moved back to front so that none is overwritten before it is
+  // moved, and the space they leave is zeroed
+  void expand(T *data, const std::vector<uint32_t> &coarse_dims,
+              const std::vector<uint32_t> &fine_dims) {
+    const uint32_t row_size = coarse_dims.back();
+    int64_t num_rows = 1;
+    for (int d = 0; d + 1 < coarse_dims.size(); d++)
+      num_rows *= coarse_dims[d];
+    auto fine_offset = [&](int64_t r) {
+      size_t offset = 0;
+      size_t stride = fine_dims.back();
+      for (int d = coarse_dims.size() - 2; d >= 0; d--) {
+        offset += (r % coarse_dims[d]) * stride;
+        r /= coarse_dims[d];
+        stride *= fine_dims[d];
       }
+      return offset;
+    };
+    size_t next_offset = fine_offset(num_rows - 1);
+    for (int64_t r = num_rows - 1; r > 0; r--) {
+      const size_t offset = next_offset;
+      next_offset = fine_offset(r - 1);
+      memmove(data + offset, data + r * row_size, row_size * sizeof(T));
+      // rows before r lie below next_offset + row_size
+      memset(data + next_offset + row_size, 0,
+             (offset - next_offset - row_size) * sizeof(T));
     }
   }
 
@@ -337,7 +485,15 @@ private:
   std::vector<uint32_t> level_num;
   std::vector<std::vector<double>> level_squared_errors;
   int current_level = -1;
-  std::vector<uint32_t> strides;
+  bool low_resolution = false;
+  bool pipelined = false;
+  double next_tolerance = 0;
+  double prefetch_ratio = 0;
+  // full resolution result of recompose_to_full
+  std::vector<T> full_data;
+  // workspace of the progressive updates, reused across steps
+  std::vector<T> delta;
+  int num_threads = 1;
 
  std::vector<uint32_t> lastRetrieveSizes;
 };
@@ -0,0 +1,255 @@
+#ifndef _MDR_PARALLEL_BLOCK_RECONSTRUCTOR_HPP
+#define _MDR_PARALLEL_BLOCK_RECONSTRUCTOR_HPP
+
+#include <functional>
+#include <string>
+#include "ReconstructorInterface.hpp"
+#include "ComposedReconstructor.hpp"
+#include "BlockLayout.hpp"
+#include "BlockScheduler.hpp"
+
+namespace MDR {
+    // statistics of one progressive reconstruction step over all blocks
+    struct BlockReconstructStats {
+        size_t retrieved_size = 0;  // bytes retrieved by this step
+        double time = 0;            // wall time of this step in seconds
+    };
+
+    // block-parallel reconstructor: inverse operator of ParallelBlockRefactor
+    // keeps the progressive state of every block and reconstructs the blocks concurrently into one global array;
+    // use several blocks per thread so that the scheduler can balance blocks of uneven cost
+    template<class T, class Decomposer, class Interleaver, class Encoder, class Compressor, class SizeInterpreter, class ErrorEstimator, class Retriever>
+    class ParallelBlockReconstructor : public concepts::ReconstructorInterface<T> {
+    public:
+        typedef ComposedReconstructor<T, Decomposer, Interleaver, Encoder, Compressor, SizeInterpreter, ErrorEstimator, Retriever> BlockReconstructor;
+
+        // retriever_factory(block_id, target_level) returns the retriever of block block_id
+        ParallelBlockReconstructor(Decomposer decomposer, Interleaver interleaver, Encoder encoder, Compressor compressor, SizeInterpreter interpreter, std::function<Retriever(uint32_t, uint8_t)> retriever_factory, const std::string& layout_file)
+            : decomposer(decomposer), interleaver(interleaver), encoder(encoder), compressor(compressor), interpreter(interpreter), retriever_factory(retriever_factory), layout_file(layout_file) {}
+
+        T * reconstruct(double tolerance){
+            return progressive_reconstruct(tolerance);
+        }
+
+        // reconstruct into an internal global array
+        T * progressive_reconstruct(double tolerance){
+            if(data.size() != num_elements()) data = std::vector<T>(num_elements(), 0);
+            progressive_reconstruct(tolerance, data.data());
+            return data.data();
+        }
+
+        // reconstruct progressively based on available data and write every block to its place in global_data
+        /*
+            @params tolerance: error tolerance of each block
+            @params global_data: caller-owned array of the global dimensions
+            @params max_level: finest level to retrieve, -1 for all levels
+        */
+        BlockReconstructStats progressive_reconstruct(double tolerance, T * global_data, int max_level=-1){
+            std::vector<uint32_t> blocks(block_reconstructors.size());
+            for(uint32_t b=0; b<blocks.size(); b++){
+                blocks[b] = b;
+            }
+            return reconstruct_blocks(tolerance, blocks, max_level, [&](T const * block_data, uint32_t b){
+                layout.scatter(block_data, b, global_data);
+            });
+        }
+
+        // reconstruct the box [region_begin, region_end) of the global array into an internal compact array
+        T * progressive_reconstruct_region(double tolerance, const std::vector<uint32_t>& region_begin, const std::vector<uint32_t>& region_end){
+            size_t n = 1;
+            for(int d=0; d<region_begin.size(); d++){
+                n *= (region_end[d] > region_begin[d]) ? region_end[d] - region_begin[d] : 0;
+            }
+            if(region_data.size() != n) region_data = std::vector<T>(n, 0);
+            progressive_reconstruct_region(tolerance, region_begin, region_end, region_data.data());
+            return region_data.data();
+        }
+
+        // reconstruct progressively only the blocks intersecting a region of interest and crop them into region_data
+        /*
+            @params tolerance: error tolerance of each block
+            @params region_begin, region_end: box [region_begin, region_end) in global coordinates
+            @params region_data: caller-owned compact array of the box
+            @params max_level: finest level to retrieve, -1 for all levels
+            the other blocks are neither retrieved nor reconstructed and keep their progressive state
+        */
+        BlockReconstructStats progressive_reconstruct_region(double tolerance, const std::vector<uint32_t>& region_begin, const std::vector<uint32_t>& region_end, T * region_data, int max_level=-1){
+            const std::vector<uint32_t>& dims = layout.dims;
+            bool valid = (region_begin.size() == dims.size()) && (region_end.size() == dims.size());
+            for(int d=0; valid && (d<dims.size()); d++){
+                if((region_begin[d] >= region_end[d]) || (region_end[d] > dims[d])) valid = false;
+            }
+            if(!valid){
+                std::cerr << "Region of interest is empty or outside the dimensions" << std::endl;
+                exit(-1);
+            }
+            return reconstruct_blocks(tolerance, layout.blocks_in_region(region_begin, region_end), max_level, [&](T const * block_data, uint32_t b){
+                layout.crop(block_data, b, region_begin, region_end, region_data);
+            });
+        }
+
+        // read the block layout and the metadata of every block once
+        void load_metadata(){
+            FILE * file = fopen(layout_file.c_str(), "r");
+            if(file == NULL){
+                std::cerr << "Cannot open block layout file " << layout_file << std::endl;
+                exit(-1);
+            }
+            fseek(file, 0, SEEK_END);
+            uint32_t num_bytes = ftell(file);
+            rewind(file);
+            uint8_t * metadata = (uint8_t *) malloc(num_bytes);
+            size_t read_bytes = fread(metadata, 1, num_bytes, file);
+            fclose(file);
+            if((num_bytes <= sizeof(uint8_t)) || (read_bytes != num_bytes)){
+                std::cerr << "Cannot read block layout file " << layout_file << ": " << read_bytes << " of " << num_bytes << " bytes read" << std::endl;
+                free(metadata);
+                exit(-1);
+            }
+            uint8_t const * metadata_pos = metadata;
+            num_levels = *(metadata_pos ++);
+            layout.deserialize(metadata_pos);
+            free(metadata);
+
+            block_reconstructors.clear();
+            for(uint32_t b=0; b<layout.num_blocks(); b++){
+                block_reconstructors.push_back(BlockReconstructor(decomposer, interleaver, encoder, compressor, interpreter, retriever_factory(b, num_levels - 1)));
+                block_reconstructors.back().set_prefetch_ratio(prefetch_ratio);
+                block_reconstructors.back().set_pipelined(pipelined);
+            }
+            const uint32_t n_blocks = block_reconstructors.size();
+            block_stored_sizes = std::vector<double>(n_blocks, 0);
+            block_retrieved_sizes = std::vector<double>(n_blocks, 0);
+            last_stats = BlockReconstructStats();
+            BlockScheduler scheduler(num_threads);
+            scheduler.run(n_blocks, std::vector<double>(), [&](uint32_t b){
+                block_reconstructors[b].load_metadata();
+                for(const auto& sizes:block_reconstructors[b].get_level_sizes()){
+                    for(const auto& size:sizes){
+                        block_stored_sizes[b] += size;
+                    }
+                }
+            });
+        }
+
+        ~ParallelBlockReconstructor(){}
+
+        // number of threads reconstructing blocks concurrently
+        void set_num_threads(int n){
+            num_threads = (n > 0) ? n : 1;
+        }
+
+        // prefetch the next step of every block, see ComposedReconstructor
+        void prefetch_tolerance(double tolerance){
+            for(auto& reconstructor:block_reconstructors){
+                reconstructor.prefetch_tolerance(tolerance);
+            }
+        }
+        void set_prefetch_ratio(double ratio){
+            prefetch_ratio = ratio;
+            for(auto& reconstructor:block_reconstructors){
+                reconstructor.set_prefetch_ratio(ratio);
+            }
+        }
+
+        // pipeline the levels within each block, see ComposedReconstructor::set_pipelined
+        void set_pipelined(bool enable){
+            pipelined = enable;
+            for(auto& reconstructor:block_reconstructors){
+                reconstructor.set_pipelined(enable);
+            }
+        }
+
+        // schedule expensive blocks first, see BlockScheduler
+        void set_cost_ordering(bool enable){
+            cost_ordering = enable;
+        }
+
+        const BlockLayout& get_layout() const {
+            return layout;
+        }
+
+        const std::vector<uint32_t>& get_dimensions() const {
+            return layout.dims;
+        }
+
+        uint8_t get_num_levels() const {
+            return num_levels;
+        }
+
+        const BlockReconstructStats& get_last_stats() const {
+            return last_stats;
+        }
+
+        void print() const {
+            std::cout << "Parallel block reconstructor with " << layout.num_blocks() << " blocks on " << num_threads << " threads using the following components." << std::endl;
+            std::cout << "Decomposer: "; decomposer.print();
+            std::cout << "Interleaver: "; interleaver.print();
+            std::cout << "Encoder: "; encoder.print();
+            std::cout << "SizeInterpreter: "; interpreter.print();
+        }
+    private:
+        // reconstruct the given blocks concurrently and hand each one to store(block_data, block_id)
+        template<class Store>
+        BlockReconstructStats reconstruct_blocks(double tolerance, const std::vector<uint32_t>& blocks, int max_level, Store store){
+            const uint32_t n_blocks = blocks.size();
+            // bytes retrieved by the previous step of a block estimate its cost, stored sizes before its first step
+            std::vector<double> costs;
+            for(uint32_t k=0; cost_ordering && (k<n_blocks); k++){
+                const uint32_t b = blocks[k];
+                costs.push_back((block_reconstructors[b].get_reconstruct_level() >= 0) ? block_retrieved_sizes[b] : block_stored_sizes[b]);
+            }
+            for(const auto& b:blocks){
+                block_retrieved_sizes[b] = 0;
+            }
+            Timer timer;
+            timer.start();
+            BlockScheduler scheduler(num_threads);
+            scheduler.run(n_blocks, costs, [&](uint32_t k){
+                const uint32_t b = blocks[k];
+                T * block_data = block_reconstructors[b].progressive_reconstruct(tolerance, max_level);
+                if(block_data == NULL) return;
+                store(block_data, b);
+                for(const auto& size:block_reconstructors[b].getLastRetrieveSizes()){
+                    block_retrieved_sizes[b] += size;
+                }
+            });
+            timer.end();
+            last_stats.time = timer.get();
+            last_stats.retrieved_size = 0;
+            for(const auto& b:blocks){
+                last_stats.retrieved_size += block_retrieved_sizes[b];
+            }
+            return last_stats;
+        }
+
+        size_t num_elements() const {
+            size_t n = 1;
+            for(const auto& d:layout.dims){
+                n *= d;
+            }
+            return n;
+        }
+
+        Decomposer decomposer;
+        Interleaver interleaver;
+        Encoder encoder;
+        Compressor compressor;
+        SizeInterpreter interpreter;
+        std::function<Retriever(uint32_t, uint8_t)> retriever_factory;
+        std::string layout_file;
+        BlockLayout layout;
+        uint8_t num_levels = 0;
+        std::vector<BlockReconstructor> block_reconstructors;
+        std::vector<T> data;
+        std::vector<T> region_data;
+        BlockReconstructStats last_stats;
+        std::vector<double> block_stored_sizes;
+        std::vector<double> block_retrieved_sizes;
+        int num_threads = 1;
+        bool cost_ordering = true;
+        double prefetch_ratio = 0;
+        bool pipelined = false;
+    };
+}
+#endif
@@ -2,5 +2,6 @@
 #define _MDR_RECONSTRUCTOR_HPP
 
 #include "ComposedReconstructor.hpp"
+#include "ParallelBlockReconstructor.hpp"
 
 #endif
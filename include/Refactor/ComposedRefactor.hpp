@@ -1,6 +1,7 @@
 #ifndef _MDR_COMPOSED_REFACTOR_HPP
 #define _MDR_COMPOSED_REFACTOR_HPP
 
+#include <type_traits>
 #include "RefactorInterface.hpp"
 #include "Decomposer/Decomposer.hpp"
 #include "Interleaver/Interleaver.hpp"
@@ -17,32 +18,33 @@ namespace MDR {
     public:
         ComposedRefactor(Decomposer decomposer, Interleaver interleaver, Encoder encoder, Compressor compressor, ErrorCollector collector, Writer writer)
             : decomposer(decomposer), interleaver(interleaver), encoder(encoder), compressor(compressor), collector(collector), writer(writer) {}
+        // the level streams only live during a refactor and are not copied
+        ComposedRefactor(const ComposedRefactor& other)
+            : decomposer(other.decomposer), interleaver(other.interleaver), encoder(other.encoder), compressor(other.compressor), collector(other.collector), writer(other.writer),
+            data(other.data), dimensions(other.dimensions), level_error_bounds(other.level_error_bounds), stopping_indices(other.stopping_indices),
+            level_sizes(other.level_sizes), level_num(other.level_num), level_squared_errors(other.level_squared_errors), num_threads(other.num_threads), release_pool(other.release_pool) {}
 
         void refactor(T const * data_, const std::vector<uint32_t>& dims, uint8_t target_level, uint8_t num_bitplanes){
-            Timer timer;
-            timer.start();
             dimensions = dims;
             uint32_t num_elements = 1;
             for(const auto& dim:dimensions){
                 num_elements *= dim;
             }
             data = std::vector<T>(data_, data_ + num_elements);
-            // if refactor successfully
-            if(refactor(target_level, num_bitplanes)){
-                timer.end();
-                // timer.print("Refactor");
-                timer.start();
-                level_num = writer.write_level_components(level_components, level_sizes);
-                timer.end();
-                // timer.print("Write");                
-            }
+            refactor_data(data.data(), target_level, num_bitplanes);
+        }
 
-            write_metadata();
-            for(int i=0; i<level_components.size(); i++){
-                for(int j=0; j<level_components[i].size(); j++){
-                    free(level_components[i][j]);                    
-                }
-            }
+        // refactor without copying the input: data_ is moved in and decomposed in place
+        void refactor(std::vector<T>&& data_, const std::vector<uint32_t>& dims, uint8_t target_level, uint8_t num_bitplanes){
+            dimensions = dims;
+            data = std::move(data_);
+            refactor_data(data.data(), target_level, num_bitplanes);
+        }
+
+        // refactor without copying the input: data_ is decomposed in place and holds the multilevel coefficients afterwards
+        void refactor_in_place(T * data_, const std::vector<uint32_t>& dims, uint8_t target_level, uint8_t num_bitplanes){
+            dimensions = dims;
+            refactor_data(data_, target_level, num_bitplanes);
         }
 
         void write_metadata() const {
@@ -65,6 +67,22 @@ namespace MDR {
 
         ~ComposedRefactor(){}
 
+        // number of threads used to encode levels concurrently (1: serial)
+        void set_num_threads(int n){
+            num_threads = (n > 0) ? n : 1;
+        }
+
+        // return the cached stream buffers to the system after each refactor (default);
+        // callers refactoring many blocks in a row turn it off and release the pool once at the end
+        void set_release_pool(bool release){
+            release_pool = release;
+        }
+
+        // sizes of the stored bitplanes of each level after the last refactor
+        const std::vector<std::vector<uint32_t>>& get_level_sizes() const {
+            return level_sizes;
+        }
+
         void print() const {
             std::cout << "Composed refactor with the following components." << std::endl;
             std::cout << "Decomposer: "; decomposer.print();
@@ -72,6 +90,60 @@ namespace MDR {
             std::cout << "Encoder: "; encoder.print();
         }
     private:
+        void refactor_data(T * data_, uint8_t target_level, uint8_t num_bitplanes){
+            Timer timer;
+            timer.start();
+            data_pos = data_;
+            bool success = refactor(target_level, num_bitplanes);
+            // if refactor successfully
+            if(success){
+                timer.end();
+                // timer.print("Refactor");
+                timer.start();
+                pass_level_errors(std::is_base_of<concepts::ErrorAwareWriterInterface, Writer>());
+                level_num = write_levels(std::is_base_of<concepts::LevelStreamWriterInterface, Writer>());
+                timer.end();
+                // timer.print("Write");                
+            }
+
+            write_metadata();
+            // the streams return to the pool in one go
+            level_components.clear();
+            // the coefficients are no longer needed once encoded
+            data_pos = NULL;
+            std::vector<T>().swap(data);
+            if(release_pool) StreamPool::release();
+        }
+
+        // hand the level errors to writers that place bitplanes by them
+        void pass_level_errors(std::true_type){
+            writer.set_level_errors(std::vector<double>(level_error_bounds.begin(), level_error_bounds.end()), level_squared_errors);
+        }
+        void pass_level_errors(std::false_type){}
+
+        // streaming writers were handed every level by refactor_level and only need to finish
+        std::vector<uint32_t> write_levels(std::true_type){
+            return writer.finish_levels(level_sizes.size());
+        }
+        std::vector<uint32_t> write_levels(std::false_type){
+            // the writer only reads the streams, which stay owned by level_components
+            std::vector<std::vector<uint8_t*>> components(level_components.size());
+            for(int i=0; i<level_components.size(); i++){
+                for(const auto& stream:level_components[i]){
+                    components[i].push_back(stream.get());
+                }
+            }
+            return writer.write_level_components(components, level_sizes);
+        }
+
+        // keep the streams of level i, or hand them to a streaming writer right away
+        void store_level(int i, std::vector<StreamBuffer>&& streams, std::true_type){
+            writer.write_level(i, std::move(streams), level_sizes[i]);
+        }
+        void store_level(int i, std::vector<StreamBuffer>&& streams, std::false_type){
+            level_components[i] = std::move(streams);
+        }
+
         bool refactor(uint8_t target_level, uint8_t num_bitplanes){
             uint8_t max_level = log2(*min_element(dimensions.begin(), dimensions.end())) - 1;
             if(target_level > max_level){
@@ -81,58 +153,66 @@ namespace MDR {
             // Timer timer;
             // decompose data hierarchically
             // timer.start();
-            decomposer.decompose(data.data(), dimensions, target_level);
+            decomposer.decompose(data_pos, dimensions, target_level);
             // timer.end();
             // timer.print("Decompose");
 
             // encode level by level
-            level_error_bounds.clear();
-            level_squared_errors.clear();
-            level_components.clear();
-            level_sizes.clear();
+            level_error_bounds = std::vector<T>(target_level + 1, 0);
+            level_squared_errors = std::vector<std::vector<double>>(target_level + 1);
+            level_components = std::vector<std::vector<StreamBuffer>>(target_level + 1);
+            level_sizes = std::vector<std::vector<uint32_t>>(target_level + 1);
+            stopping_indices = std::vector<uint8_t>(target_level + 1, 0);
             auto level_dims = compute_level_dims(dimensions, target_level);
             auto level_elements = compute_level_elements(level_dims, target_level);
-            std::vector<uint32_t> dims_dummy(dimensions.size(), 0);
-            SquaredErrorCollector<T> s_collector = SquaredErrorCollector<T>();
-            for(int i=0; i<=target_level; i++){
-                // timer.start();
-                const std::vector<uint32_t>& prev_dims = (i == 0) ? dims_dummy : level_dims[i - 1];
-                T * buffer = (T *) malloc(level_elements[i] * sizeof(T));
-                // extract level i component
-                interleaver.interleave(data.data(), dimensions, level_dims[i], prev_dims, reinterpret_cast<T*>(buffer));
-                // compute max coefficient as level error bound
-                T level_max_error = compute_max_abs_value(reinterpret_cast<T*>(buffer), level_elements[i]);
-                level_error_bounds.push_back(level_max_error);
-                // timer.end();
-                // timer.print("Interleave");
-                // collect errors
-                // auto collected_error = s_collector.collect_level_error(buffer, level_elements[i], num_bitplanes, level_max_error);
-                // level_squared_errors.push_back(collected_error);
-                // encode level data
-                // timer.start();
-                int level_exp = 0;
-                frexp(level_max_error, &level_exp);
-                std::vector<uint32_t> stream_sizes;
-                std::vector<double> level_sq_err;
-                auto streams = encoder.encode(buffer, level_elements[i], level_exp, num_bitplanes, stream_sizes, level_sq_err);
-                free(buffer);
-                level_squared_errors.push_back(level_sq_err);
-                // timer.end();
-                // timer.print("Encoding");
-                // timer.start();
-                // lossless compression
-                uint8_t stopping_index = compressor.compress_level(streams, stream_sizes);
-                stopping_indices.push_back(stopping_index);
-                // record encoded level data and size
-                level_components.push_back(streams);
-                level_sizes.push_back(stream_sizes);
-                // timer.end();
-                // timer.print("Lossless time");
+            // levels are independent after decomposition: each one writes only its own slot,
+            // so they can be encoded concurrently as tasks (finest level first as it is the largest)
+            #pragma omp parallel num_threads(num_threads) if(num_threads > 1)
+            #pragma omp single
+            {
+                for(int i=target_level; i>=0; i--){
+                    #pragma omp task firstprivate(i) shared(level_dims, level_elements)
+                    refactor_level(i, level_dims, level_elements, num_bitplanes);
+                }
             }
             // print_vec("level sizes", level_sizes);
             return true;
         }
 
+        // interleave, encode and compress level i into its own slot
+        void refactor_level(int i, const std::vector<std::vector<uint32_t>>& level_dims, const std::vector<uint32_t>& level_elements, uint8_t num_bitplanes){
+            // timer.start();
+            std::vector<uint32_t> dims_dummy(dimensions.size(), 0);
+            const std::vector<uint32_t>& prev_dims = (i == 0) ? dims_dummy : level_dims[i - 1];
+            const uint32_t num_level_elements = level_elements[i];
+            // compute max coefficient as level error bound, reading level i in place
+            T level_max_error = interleaver.max_abs_value(data_pos, dimensions, level_dims[i], prev_dims);
+            level_error_bounds[i] = level_max_error;
+            // timer.end();
+            // timer.print("Interleave");
+            // encode level data
+            // timer.start();
+            int level_exp = 0;
+            frexp(level_max_error, &level_exp);
+            std::vector<uint32_t> stream_sizes;
+            std::vector<double> level_sq_err;
+            // extract level i component tile by tile while encoding, without a full-size level buffer
+            LevelTileReader<T, Interleaver> tiles(interleaver, data_pos, dimensions, level_dims[i], prev_dims);
+            auto streams = encoder.encode_tiles(tiles, num_level_elements, level_exp, num_bitplanes, stream_sizes, level_sq_err);
+            level_squared_errors[i] = level_sq_err;
+            // timer.end();
+            // timer.print("Encoding");
+            // timer.start();
+            // lossless compression
+            uint8_t stopping_index = compressor.compress_level(streams, stream_sizes);
+            stopping_indices[i] = stopping_index;
+            // record encoded level data and size
+            level_sizes[i] = stream_sizes;
+            store_level(i, std::move(streams), std::is_base_of<concepts::LevelStreamWriterInterface, Writer>());
+            // timer.end();
+            // timer.print("Lossless time");
+        }
+
         Decomposer decomposer;
         Interleaver interleaver;
         Encoder encoder;
@@ -140,13 +220,16 @@ namespace MDR {
         ErrorCollector collector;
         Writer writer;
         std::vector<T> data;
+        T * data_pos = NULL;    // array being refactored: data or a caller buffer
         std::vector<uint32_t> dimensions;
         std::vector<T> level_error_bounds;
         std::vector<uint8_t> stopping_indices;
-        std::vector<std::vector<uint8_t*>> level_components;
+        std::vector<std::vector<StreamBuffer>> level_components;
         std::vector<std::vector<uint32_t>> level_sizes;
         std::vector<uint32_t> level_num;
         std::vector<std::vector<double>> level_squared_errors;
+        int num_threads = 1;
+        bool release_pool = true;
     };
 }
 #endif
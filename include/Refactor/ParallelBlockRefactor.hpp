@@ -0,0 +1,138 @@
+#ifndef _MDR_PARALLEL_BLOCK_REFACTOR_HPP
+#define _MDR_PARALLEL_BLOCK_REFACTOR_HPP
+
+#include <functional>
+#include <string>
+#include "RefactorInterface.hpp"
+#include "ComposedRefactor.hpp"
+#include "BlockLayout.hpp"
+#include "BlockScheduler.hpp"
+#include "Writer/SegmentFileIO.hpp"
+
+namespace MDR {
+    // block-parallel refactor: partition the data into a grid of blocks and refactor each block
+    // independently with its own ComposedRefactor; the block layout is written to layout_file
+    template<class T, class Decomposer, class Interleaver, class Encoder, class Compressor, class ErrorCollector, class Writer>
+    class ParallelBlockRefactor : public concepts::RefactorInterface<T> {
+    public:
+        // writer_factory(block_id, target_level) returns the writer of block block_id
+        ParallelBlockRefactor(Decomposer decomposer, Interleaver interleaver, Encoder encoder, Compressor compressor, ErrorCollector collector, std::function<Writer(uint32_t, uint8_t)> writer_factory, const std::string& layout_file)
+            : decomposer(decomposer), interleaver(interleaver), encoder(encoder), compressor(compressor), collector(collector), writer_factory(writer_factory), layout_file(layout_file) {}
+
+        void refactor(T const * data_, const std::vector<uint32_t>& dims, uint8_t target_level, uint8_t num_bitplanes){
+            refactor_blocks(const_cast<T *>(data_), dims, target_level, num_bitplanes, false);
+        }
+
+        // refactor without copying slabs: data_ is decomposed in place and its content is undefined afterwards
+        void refactor_in_place(T * data_, const std::vector<uint32_t>& dims, uint8_t target_level, uint8_t num_bitplanes){
+            refactor_blocks(data_, dims, target_level, num_bitplanes, true);
+        }
+
+        // number of levels of every block, then the block layout
+        void write_metadata() const {
+            uint32_t metadata_size = sizeof(uint8_t) + layout.serialized_size();
+            uint8_t * metadata = (uint8_t *) malloc(metadata_size);
+            uint8_t * metadata_pos = metadata;
+            *(metadata_pos ++) = num_levels;
+            layout.serialize(metadata_pos);
+            bool written = write_file_segments(layout_file, std::vector<const uint8_t*>(1, metadata), std::vector<uint32_t>(1, metadata_size));
+            free(metadata);
+            if(!written) exit(-1);
+        }
+
+        ~ParallelBlockRefactor(){}
+
+        // number of threads refactoring blocks concurrently
+        void set_num_threads(int n){
+            num_threads = (n > 0) ? n : 1;
+        }
+
+        // requested number of blocks; fewer are used if the blocks would be too thin for target_level
+        // use several blocks per thread so that the scheduler can balance blocks of uneven cost
+        void set_num_blocks(int n){
+            num_blocks = (n > 0) ? n : 1;
+        }
+
+        // schedule expensive blocks first, using the stream sizes of the previous refactor of the same layout
+        void set_cost_ordering(bool enable){
+            cost_ordering = enable;
+        }
+
+        void set_block_shape(BlockShape s){
+            shape = s;
+        }
+
+        const BlockLayout& get_layout() const {
+            return layout;
+        }
+
+        void print() const {
+            std::cout << "Parallel block refactor with " << num_blocks << " blocks on " << num_threads << " threads using the following components." << std::endl;
+            std::cout << "Decomposer: "; decomposer.print();
+            std::cout << "Interleaver: "; interleaver.print();
+            std::cout << "Encoder: "; encoder.print();
+        }
+    private:
+        void refactor_blocks(T * data_, const std::vector<uint32_t>& dims, uint8_t target_level, uint8_t num_bitplanes, bool in_place){
+            // blocks must stay large enough to be decomposed to target_level
+            auto grid = choose_block_grid(dims, num_blocks, shape, 1u << (target_level + 1));
+            bool same_layout = (layout.dims == dims) && (layout.grid == grid);
+            layout = BlockLayout(dims, grid);
+            num_levels = target_level + 1;
+            const uint32_t n_blocks = layout.num_blocks();
+            // stream sizes of the previous refactor estimate the cost of each block, otherwise the block sizes do
+            std::vector<double> costs;
+            if(cost_ordering){
+                if(same_layout && (block_stream_sizes.size() == n_blocks)) costs = block_stream_sizes;
+                else for(uint32_t b=0; b<n_blocks; b++) costs.push_back(layout.block_elements(b));
+            }
+            block_stream_sizes = std::vector<double>(n_blocks, 0);
+            BlockScheduler scheduler(num_threads);
+            scheduler.run(n_blocks, costs, [&](uint32_t b){
+                refactor_block(data_, b, target_level, num_bitplanes, in_place);
+            });
+            write_metadata();
+            // the blocks share the cached streams while they run
+            StreamPool::release();
+        }
+
+        // data_ is only written if in_place is set
+        void refactor_block(T * data_, uint32_t b, uint8_t target_level, uint8_t num_bitplanes, bool in_place){
+            ComposedRefactor<T, Decomposer, Interleaver, Encoder, Compressor, ErrorCollector, Writer> block_refactor(decomposer, interleaver, encoder, compressor, collector, writer_factory(b, target_level));
+            block_refactor.set_release_pool(false);
+            if(layout.contiguous()){
+                // slabs are read straight from the global array
+                T * block_pos = data_ + layout.global_offset(b);
+                if(in_place) block_refactor.refactor_in_place(block_pos, layout.block_dims[b], target_level, num_bitplanes);
+                else block_refactor.refactor(block_pos, layout.block_dims[b], target_level, num_bitplanes);
+            }
+            else{
+                // other blocks are gathered once and handed over without another copy
+                std::vector<T> block_data(layout.block_elements(b));
+                layout.gather(data_, b, block_data.data());
+                block_refactor.refactor(std::move(block_data), layout.block_dims[b], target_level, num_bitplanes);
+            }
+            for(const auto& sizes:block_refactor.get_level_sizes()){
+                for(const auto& size:sizes){
+                    block_stream_sizes[b] += size;
+                }
+            }
+        }
+
+        Decomposer decomposer;
+        Interleaver interleaver;
+        Encoder encoder;
+        Compressor compressor;
+        ErrorCollector collector;
+        std::function<Writer(uint32_t, uint8_t)> writer_factory;
+        std::string layout_file;
+        BlockLayout layout;
+        uint8_t num_levels = 0;
+        std::vector<double> block_stream_sizes;
+        int num_threads = 1;
+        int num_blocks = 1;
+        BlockShape shape = BLOCK_AUTO;
+        bool cost_ordering = true;
+    };
+}
+#endif
@@ -4,28 +4,39 @@
 #include "ReorganizerInterface.hpp"
 
 namespace MDR {
+    // concatenate the bitplanes in placement order
+    inline uint8_t * concatenate_in_order(const std::vector<std::vector<uint8_t*>>& level_components, const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<uint8_t>& order, uint32_t& total_size){
+        total_size = 0;
+        std::vector<int> next(level_sizes.size(), 0);
+        for(const auto& i:order){
+            total_size += level_sizes[i][next[i] ++];
+        }
+        uint8_t * reorganized_data = (uint8_t *) malloc(total_size);
+        uint8_t * reorganized_data_pos = reorganized_data;
+        next = std::vector<int>(level_sizes.size(), 0);
+        for(const auto& i:order){
+            int j = next[i] ++;
+            memcpy(reorganized_data_pos, level_components[i][j], level_sizes[i][j]);
+            reorganized_data_pos += level_sizes[i][j];
+        }
+        return reorganized_data;
+    }
+
     // direct in-order bit-plane placement
     class InOrderReorganizer : public concepts::ReorganizerInterface {
     public:
         InOrderReorganizer(){}
         uint8_t * reorganize(const std::vector<std::vector<uint8_t*>>& level_components, const std::vector<std::vector<uint32_t>>& level_sizes, std::vector<uint8_t>& order, uint32_t& total_size) const {
-            const int num_levels = level_sizes.size();
-            total_size = 0;
-            for(int i=0; i<num_levels; i++){
-                for(int j=0; j<level_sizes[i].size(); j++){
-                    total_size += level_sizes[i][j];
-                }
-            }
-            uint8_t * reorganized_data = (uint8_t *) malloc(total_size);
-            uint8_t * reorganized_data_pos = reorganized_data;
-            for(int i=0; i<num_levels; i++){
-                for(int j=0; j<level_sizes[i].size(); j++){
-                    order.push_back(i);
-                    memcpy(reorganized_data_pos, level_components[i][j], level_sizes[i][j]);
-                    reorganized_data_pos += level_sizes[i][j];
-                }
+            auto placement = placement_order(level_sizes, std::vector<double>(), std::vector<std::vector<double>>());
+            order.insert(order.end(), placement.begin(), placement.end());
+            return concatenate_in_order(level_components, level_sizes, placement, total_size);
+        }
+        std::vector<uint8_t> placement_order(const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<double>& level_error_bounds, const std::vector<std::vector<double>>& level_squared_errors) const {
+            std::vector<uint8_t> order;
+            for(int i=0; i<level_sizes.size(); i++){
+                order.insert(order.end(), level_sizes[i].size(), i);
             }
-            return reorganized_data;
+            return order;
         }
         void print() const {
             std::cout << "In-order reorganizer." << std::endl;
@@ -36,34 +47,29 @@ namespace MDR {
     public:
         RoundRobinReorganizer(){}
         uint8_t * reorganize(const std::vector<std::vector<uint8_t*>>& level_components, const std::vector<std::vector<uint32_t>>& level_sizes, std::vector<uint8_t>& order, uint32_t& total_size) const {
+            auto placement = placement_order(level_sizes, std::vector<double>(), std::vector<std::vector<double>>());
+            order.insert(order.end(), placement.begin(), placement.end());
+            return concatenate_in_order(level_components, level_sizes, placement, total_size);
+        }
+        std::vector<uint8_t> placement_order(const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<double>& level_error_bounds, const std::vector<std::vector<double>>& level_squared_errors) const {
             const int num_levels = level_sizes.size();
-            total_size = 0;
-            for(int i=0; i<num_levels; i++){
-                for(int j=0; j<level_sizes[i].size(); j++){
-                    total_size += level_sizes[i][j];
-                }
-            }
-            uint8_t * reorganized_data = (uint8_t *) malloc(total_size);
-            uint8_t * reorganized_data_pos = reorganized_data;
             int max_level_size = 0;
             for(int i=0; i<num_levels; i++){
                 if(level_sizes[i].size() > max_level_size){
                     max_level_size = level_sizes[i].size();
                 }
             }
-            for(int j=0; j<max_level_size - 1; j++){
+            std::vector<uint8_t> order;
+            for(int j=0; j<max_level_size; j++){
                 for(int i=0; i<num_levels; i++){
-                    if(j >= level_sizes[i].size() - 1) continue;
-                    order.push_back(i);
-                    memcpy(reorganized_data_pos, level_components[i][j], level_sizes[i][j]);
-                    reorganized_data_pos += level_sizes[i][j];
+                    if(j < level_sizes[i].size()) order.push_back(i);
                 }
             }
-            return reorganized_data;
+            return order;
         }
         void print() const {
             std::cout << "Round-robin reorganizer." << std::endl;
         }
     };
 }
-#endif
\ No newline at end of file
+#endif
@@ -12,6 +12,9 @@ namespace MDR {
 
             virtual uint8_t * reorganize(const std::vector<std::vector<uint8_t*>>& level_components, const std::vector<std::vector<uint32_t>>& level_sizes, std::vector<uint8_t>& order, uint32_t& total_size) const = 0;
 
+            // placement of all bitplanes given as the level of each placed bitplane: the k-th occurrence of level i is bitplane k of level i
+            virtual std::vector<uint8_t> placement_order(const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<double>& level_error_bounds, const std::vector<std::vector<double>>& level_squared_errors) const = 0;
+
             virtual void print() const = 0;
         };
     }
@@ -0,0 +1,76 @@
+#ifndef _MDR_RETRIEVAL_ORDER_REORGANIZER_HPP
+#define _MDR_RETRIEVAL_ORDER_REORGANIZER_HPP
+
+#include <type_traits>
+#include "ReorganizerInterface.hpp"
+#include "BasicReorganizer.hpp"
+#include "ErrorCollector/ErrorCollector.hpp"
+#include "ErrorEstimator/ErrorEstimator.hpp"
+
+namespace MDR {
+    // bit-plane placement in expected retrieval order
+    // replays the size interpreter of the reconstruction over a sequence of expected tolerances, so that the bitplanes
+    // fetched by each progressive step are stored back to back (grouped by level) after those of the previous steps;
+    // bitplanes no tolerance reaches are placed last, level by level
+    template<class T, class ErrorEstimator, class SizeInterpreter>
+    class RetrievalOrderReorganizer : public concepts::ReorganizerInterface {
+    public:
+        /*
+            @params interpreter: size interpreter used for the reconstruction, with the same error estimator
+            @params tolerances: expected tolerances of the progressive steps, in retrieval order
+        */
+        RetrievalOrderReorganizer(const SizeInterpreter& interpreter, const std::vector<double>& tolerances) : interpreter(interpreter), tolerances(tolerances) {}
+        /*
+            @params interpreter: size interpreter used for the reconstruction, with the same error estimator
+            @params tolerances: expected tolerances of the progressive steps, in retrieval order
+            @params level_error_bounds: level error bounds of the refactored data, used by reorganize
+            @params level_squared_errors: level squared errors of the refactored data, used by reorganize
+        */
+        RetrievalOrderReorganizer(const SizeInterpreter& interpreter, const std::vector<double>& tolerances, const std::vector<double>& level_error_bounds, const std::vector<std::vector<double>>& level_squared_errors) : interpreter(interpreter), tolerances(tolerances), level_error_bounds(level_error_bounds), level_squared_errors(level_squared_errors) {}
+
+        uint8_t * reorganize(const std::vector<std::vector<uint8_t*>>& level_components, const std::vector<std::vector<uint32_t>>& level_sizes, std::vector<uint8_t>& order, uint32_t& total_size) const {
+            if((level_error_bounds.size() != level_sizes.size()) || (level_squared_errors.size() != level_sizes.size())){
+                std::cerr << "Retrieval-order reorganizer needs the errors of " << level_sizes.size() << " levels, pass them to the constructor" << std::endl;
+                exit(-1);
+            }
+            auto placement = placement_order(level_sizes, level_error_bounds, level_squared_errors);
+            order.insert(order.end(), placement.begin(), placement.end());
+            return concatenate_in_order(level_components, level_sizes, placement, total_size);
+        }
+
+        std::vector<uint8_t> placement_order(const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<double>& level_error_bounds, const std::vector<std::vector<double>>& level_squared_errors) const {
+            const int num_levels = level_sizes.size();
+            // the errors the interpreter sees during reconstruction, see ComposedReconstructor
+            std::vector<std::vector<double>> level_errors = level_squared_errors;
+            if(std::is_base_of<MaxErrorEstimator<T>, ErrorEstimator>::value){
+                MaxErrorCollector<T> collector = MaxErrorCollector<T>();
+                for(int i=0; i<num_levels; i++){
+                    level_errors[i] = collector.collect_level_error(NULL, 0, level_squared_errors[i].size(), level_error_bounds[i]);
+                }
+            }
+            std::vector<uint8_t> order;
+            std::vector<uint8_t> index(num_levels, 0);
+            for(const auto& tolerance:tolerances){
+                auto prev_index(index);
+                interpreter.interpret_retrieve_size(level_sizes, level_errors, tolerance, index);
+                for(int i=0; i<num_levels; i++){
+                    order.insert(order.end(), index[i] - prev_index[i], i);
+                }
+            }
+            for(int i=0; i<num_levels; i++){
+                order.insert(order.end(), level_sizes[i].size() - index[i], i);
+            }
+            return order;
+        }
+
+        void print() const {
+            std::cout << "Retrieval-order reorganizer for " << tolerances.size() << " tolerances." << std::endl;
+        }
+    private:
+        SizeInterpreter interpreter;
+        std::vector<double> tolerances;
+        std::vector<double> level_error_bounds;
+        std::vector<std::vector<double>> level_squared_errors;
+    };
+}
+#endif
@@ -0,0 +1,173 @@
+#ifndef _MDR_CONTAINER_FILE_RETRIEVER_HPP
+#define _MDR_CONTAINER_FILE_RETRIEVER_HPP
+
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include "RetrieverInterface.hpp"
+#include "MmapFileRetriever.hpp"
+#include "ContainerFormat.hpp"
+
+namespace MDR {
+    // container file mapped once and shared by the retrievers of all blocks, in either layout
+    class ContainerFileReader {
+    public:
+        ContainerFileReader(const std::string& path) : path(path), file(path) {
+            const size_t min_size = ContainerIndex::HEADER_SIZE + ContainerIndex::TRAILER_SIZE;
+            if(file.get_size() < min_size) fail("too small");
+            uint8_t const * header_pos = file.get();
+            uint8_t const * header_end = file.get() + ContainerIndex::HEADER_SIZE;
+            uint32_t magic = 0, version = 0, layout_id = 0;
+            ContainerIndex::get(header_pos, header_end, magic);
+            ContainerIndex::get(header_pos, header_end, version);
+            ContainerIndex::get(header_pos, header_end, layout_id);
+            if((magic != ContainerIndex::MAGIC) || (version != ContainerIndex::VERSION)) fail("not a container of this version");
+            layout = static_cast<ContainerLayout>(layout_id);
+            uint8_t const * trailer_pos = file.get() + file.get_size() - ContainerIndex::TRAILER_SIZE;
+            uint8_t const * trailer_end = file.get() + file.get_size();
+            uint64_t index_offset = 0;
+            uint32_t index_size = 0;
+            ContainerIndex::get(trailer_pos, trailer_end, index_offset);
+            ContainerIndex::get(trailer_pos, trailer_end, index_size);
+            ContainerIndex::get(trailer_pos, trailer_end, magic);
+            if((magic != ContainerIndex::MAGIC) || (index_offset + index_size + ContainerIndex::TRAILER_SIZE != file.get_size())) fail("missing index, was the container closed?");
+            uint8_t const * index_pos = file.get() + index_offset;
+            if(!index.deserialize(index_pos, index_pos + index_size)) fail("truncated index");
+            for(const auto& block:index.blocks){
+                if(block.metadata_offset + block.metadata_size > index_offset) fail("corrupted index");
+                for(const auto& level:block.levels){
+                    for(int j=0; j<level.sizes.size(); j++){
+                        if(level.offsets[j] + level.sizes[j] > index_offset) fail("corrupted index");
+                    }
+                }
+            }
+            if(layout == CONTAINER_PLANE_MAJOR) locate_plane_groups();
+        }
+        ContainerFileReader(const ContainerFileReader&) = delete;
+        ContainerFileReader& operator=(const ContainerFileReader&) = delete;
+
+        uint32_t num_blocks() const {
+            return index.blocks.size();
+        }
+
+        const ContainerBlockEntry& block(uint32_t b) const {
+            if(b >= index.blocks.size()) fail("no such block");
+            return index.blocks[b];
+        }
+
+        const MappedFile& get_file() const {
+            return file;
+        }
+
+        ContainerLayout get_layout() const {
+            return layout;
+        }
+
+        // prefetch bitplanes [begin, end) of level of block b
+        // plane-major: the first block asking for a bitplane prefetches it for all blocks, so the blocks of a progressive step
+        // share one readahead per level instead of issuing one each
+        void will_need(uint32_t b, int level, int begin, int end){
+            if(begin >= end) return;
+            const ContainerLevelEntry& entry = block(b).levels[level];
+            if(layout != CONTAINER_PLANE_MAJOR){
+                file.will_need(entry.offsets[begin], entry.offsets[end - 1] + entry.sizes[end - 1] - entry.offsets[begin]);
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            int& advised = advised_planes[level];
+            if(end <= advised) return;
+            begin = std::max(begin, advised);
+            file.will_need(plane_groups[level][begin].first, plane_groups[level][end - 1].second - plane_groups[level][begin].first);
+            advised = end;
+        }
+    private:
+        // extent of bitplane k of level l over all blocks
+        void locate_plane_groups(){
+            for(const auto& block:index.blocks){
+                if(plane_groups.size() < block.levels.size()) plane_groups.resize(block.levels.size());
+                for(int i=0; i<block.levels.size(); i++){
+                    const ContainerLevelEntry& level = block.levels[i];
+                    if(plane_groups[i].size() < level.sizes.size()) plane_groups[i].resize(level.sizes.size(), std::make_pair(UINT64_MAX, 0));
+                    for(int j=0; j<level.sizes.size(); j++){
+                        plane_groups[i][j].first = std::min(plane_groups[i][j].first, level.offsets[j]);
+                        plane_groups[i][j].second = std::max(plane_groups[i][j].second, level.offsets[j] + level.sizes[j]);
+                    }
+                }
+            }
+            advised_planes = std::vector<int>(plane_groups.size(), 0);
+        }
+
+        void fail(const char * reason) const {
+            std::cerr << "Cannot read container " << path << ": " << reason << std::endl;
+            exit(-1);
+        }
+
+        std::string path;
+        MappedFile file;
+        ContainerIndex index;
+        ContainerLayout layout = CONTAINER_BLOCK_MAJOR;
+        std::vector<std::vector<std::pair<uint64_t, uint64_t>>> plane_groups;
+        std::vector<int> advised_planes;
+        std::mutex mutex;
+    };
+
+    // zero-copy retriever of one block of a container file; see MmapLevelFileRetriever
+    class ContainerFileRetriever : public concepts::LevelRetrieverInterface {
+    public:
+        ContainerFileRetriever(std::shared_ptr<ContainerFileReader> container, uint32_t block_id=0) : container(container), block_id(block_id) {}
+
+        // retriever of another block of the same container
+        ContainerFileRetriever for_block(uint32_t b) const {
+            return ContainerFileRetriever(container, b);
+        }
+
+        std::vector<std::vector<const uint8_t*>> retrieve_level_components(const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<uint32_t>& retrieve_sizes, const std::vector<uint8_t>& prev_level_num_bitplanes, const std::vector<uint8_t>& level_num_bitplanes){
+            if(offsets.size() != retrieve_sizes.size()) offsets = std::vector<uint32_t>(retrieve_sizes.size(), 0);
+            uint32_t total_retrieve_size = 0;
+            std::vector<std::vector<const uint8_t*>> level_components(level_num_bitplanes.size());
+            for(int i=0; i<retrieve_sizes.size(); i++){
+                level_components[i] = retrieve_level(i, level_sizes[i], retrieve_sizes[i], prev_level_num_bitplanes[i], level_num_bitplanes[i]);
+                offsets[i] += retrieve_sizes[i];
+                total_retrieve_size += offsets[i];
+            }
+            if(retrieve_logging()) std::cout << "Total retrieve size = " << total_retrieve_size << std::endl;
+            return level_components;
+        }
+
+        std::vector<const uint8_t*> retrieve_level(int level, const std::vector<uint32_t>& level_sizes, uint32_t retrieve_size, uint8_t prev_num_bitplanes, uint8_t num_bitplanes){
+            print_retrieve(level, prev_num_bitplanes, num_bitplanes);
+            const ContainerBlockEntry& block = container->block(block_id);
+            if((level >= block.levels.size()) || (num_bitplanes > block.levels[level].sizes.size())){
+                std::cerr << "Retrieve beyond level " << level << " of block " << block_id << std::endl;
+                exit(-1);
+            }
+            container->will_need(block_id, level, prev_num_bitplanes, num_bitplanes);
+            std::vector<const uint8_t*> components;
+            for(int j=prev_num_bitplanes; j<num_bitplanes; j++){
+                components.push_back(container->get_file().get() + block.levels[level].offsets[j]);
+            }
+            return components;
+        }
+
+        uint8_t * load_metadata() const {
+            const ContainerBlockEntry& block = container->block(block_id);
+            uint8_t * metadata = (uint8_t *) malloc(block.metadata_size);
+            memcpy(metadata, container->get_file().get() + block.metadata_offset, block.metadata_size);
+            return metadata;
+        }
+
+        // the container stays mapped for the lifetime of the reader
+        void release(){}
+
+        ~ContainerFileRetriever(){}
+
+        void print() const {
+            std::cout << "Container file retriever." << std::endl;
+        }
+    private:
+        std::shared_ptr<ContainerFileReader> container;
+        uint32_t block_id;
+        std::vector<uint32_t> offsets;
+    };
+}
+#endif
@@ -3,54 +3,153 @@
 
 #include "RetrieverInterface.hpp"
 #include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "StreamPool.hpp"
 
 namespace MDR {
+    // level files opened once and shared by all copies of a retriever
+    class LevelFileHandles {
+    public:
+        LevelFileHandles(const std::vector<std::string>& files) : files(files), fds(files.size(), -1) {}
+        ~LevelFileHandles(){
+            for(const auto& fd:fds){
+                if(fd >= 0) close(fd);
+            }
+        }
+        LevelFileHandles(const LevelFileHandles&) = delete;
+        LevelFileHandles& operator=(const LevelFileHandles&) = delete;
+
+        // descriptor of file i, opened on first use
+        int get(int i){
+            std::lock_guard<std::mutex> lock(mutex);
+            if(fds[i] < 0){
+                fds[i] = open(files[i].c_str(), O_RDONLY);
+                if(fds[i] < 0){
+                    std::cerr << "Cannot open " << files[i] << ": " << strerror(errno) << std::endl;
+                }
+            }
+            return fds[i];
+        }
+    private:
+        std::vector<std::string> files;
+        std::vector<int> fds;
+        std::mutex mutex;
+    };
+
+    // read size bytes at offset with pread, retrying short reads; returns the number of bytes read
+    inline size_t read_file_range(int fd, uint8_t * buffer, size_t size, off_t offset){
+        size_t done = 0;
+        while(done < size){
+            ssize_t n = pread(fd, buffer + done, size - done, offset + done);
+            if(n < 0){
+                if(errno == EINTR) continue;
+                std::cerr << "Errors in pread while retrieving from file: " << strerror(errno) << std::endl;
+                break;
+            }
+            if(n == 0) break;
+            done += n;
+        }
+        return done;
+    }
+
+    // position of the bitplane num_bitplanes of a level in its concatenated level file
+    inline uint64_t level_file_offset(const std::vector<uint32_t>& level_sizes, uint8_t num_bitplanes){
+        uint64_t offset = 0;
+        for(int j=0; j<num_bitplanes; j++){
+            offset += level_sizes[j];
+        }
+        return offset;
+    }
+
     // Data retriever for files
-    class ConcatLevelFileRetriever : public concepts::RetrieverInterface {
+    // level files stay open across progressive steps and are read with pread into pooled buffers, levels concurrently
+    class ConcatLevelFileRetriever : public concepts::LevelRetrieverInterface {
     public:
-        ConcatLevelFileRetriever(const std::string& metadata_file, const std::vector<std::string>& level_files) : metadata_file(metadata_file), level_files(level_files) {
-            offsets = std::vector<uint32_t>(level_files.size(), 0);
+        ConcatLevelFileRetriever(const std::string& metadata_file, const std::vector<std::string>& level_files, int num_threads = 1) : metadata_file(metadata_file), level_files(level_files), num_threads(num_threads) {
+            handles = std::make_shared<LevelFileHandles>(level_files);
         }
 
         std::vector<std::vector<const uint8_t*>> retrieve_level_components(const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<uint32_t>& retrieve_sizes, const std::vector<uint8_t>& prev_level_num_bitplanes, const std::vector<uint8_t>& level_num_bitplanes){
             // assert(offsets.size() == retrieve_sizes.size());
             release();
             uint32_t total_retrieve_size = 0;
+            // the new bitplanes follow the retrieved ones, so that every step can be read independently
+            std::vector<uint64_t> offsets;
             for(int i=0; i<retrieve_sizes.size(); i++){
-                std::cout << "Retrieve " << +level_num_bitplanes[i] << " (" << +(level_num_bitplanes[i] - prev_level_num_bitplanes[i]) << " more) bitplanes from level " << i << std::endl;
-                FILE * file = fopen(level_files[i].c_str(), "r");
-                if(fseek(file, offsets[i], SEEK_SET)){
-                    std::cerr << "Errors in fseek while retrieving from file" << std::endl;
+                print_retrieve(i, prev_level_num_bitplanes[i], level_num_bitplanes[i]);
+                concated_level_components.push_back(StreamPool::allocate(retrieve_sizes[i]));
+                offsets.push_back(level_file_offset(level_sizes[i], prev_level_num_bitplanes[i]));
+                total_retrieve_size += offsets[i] + retrieve_sizes[i];
+            }
+            const int num_levels = retrieve_sizes.size();
+            bool failed = false;
+            #pragma omp parallel for schedule(dynamic) num_threads(num_threads) if((num_threads > 1) && (num_levels > 1)) reduction(||:failed)
+            for(int i=0; i<num_levels; i++){
+                if(retrieve_sizes[i] == 0) continue;
+                int fd = handles->get(i);
+                if((fd < 0) || (read_file_range(fd, concated_level_components[i], retrieve_sizes[i], offsets[i]) != retrieve_sizes[i])){
+                    std::cerr << "Cannot read " << retrieve_sizes[i] << " bytes from " << level_files[i] << std::endl;
+                    failed = true;
                 }
-                uint8_t * buffer = (uint8_t *) malloc(retrieve_sizes[i]);
-                fread(buffer, sizeof(uint8_t), retrieve_sizes[i], file);
-                concated_level_components.push_back(buffer);
-                fclose(file);
-                offsets[i] += retrieve_sizes[i];
-                total_retrieve_size += offsets[i];
             }
-            std::cout << "Total retrieve size = " << total_retrieve_size << std::endl;
+            if(failed) exit(-1);
+            if(retrieve_logging()) std::cout << "Total retrieve size = " << total_retrieve_size << std::endl;
             return interleave_level_components(level_sizes, prev_level_num_bitplanes, level_num_bitplanes);
         }
 
+        std::vector<const uint8_t*> retrieve_level(int level, const std::vector<uint32_t>& level_sizes, uint32_t retrieve_size, uint8_t prev_num_bitplanes, uint8_t num_bitplanes){
+            print_retrieve(level, prev_num_bitplanes, num_bitplanes);
+            uint8_t * buffer = StreamPool::allocate(retrieve_size);
+            concated_level_components.push_back(buffer);
+            if(retrieve_size > 0){
+                int fd = handles->get(level);
+                if((fd < 0) || (read_file_range(fd, buffer, retrieve_size, level_file_offset(level_sizes, prev_num_bitplanes)) != retrieve_size)){
+                    std::cerr << "Cannot read " << retrieve_size << " bytes from " << level_files[level] << std::endl;
+                    exit(-1);
+                }
+            }
+            std::vector<const uint8_t*> components;
+            const uint8_t * pos = buffer;
+            for(int j=prev_num_bitplanes; j<num_bitplanes; j++){
+                components.push_back(pos);
+                pos += level_sizes[j];
+            }
+            return components;
+        }
+
         uint8_t * load_metadata() const {
-            FILE * file = fopen(metadata_file.c_str(), "r");
-            fseek(file, 0, SEEK_END);
-            uint32_t num_bytes = ftell(file);
-            rewind(file);
+            int fd = open(metadata_file.c_str(), O_RDONLY);
+            if(fd < 0){
+                std::cerr << "Cannot open " << metadata_file << ": " << strerror(errno) << std::endl;
+                exit(-1);
+            }
+            struct stat st;
+            fstat(fd, &st);
+            uint32_t num_bytes = st.st_size;
             uint8_t * metadata = (uint8_t *) malloc(num_bytes);
-            fread(metadata, 1, num_bytes, file);
-            fclose(file);
+            read_file_range(fd, metadata, num_bytes, 0);
+            close(fd);
             return metadata;
         }
 
         void release(){
             for(int i=0; i<concated_level_components.size(); i++){
-                free(concated_level_components[i]);
+                StreamPool::deallocate(concated_level_components[i]);
             }
             concated_level_components.clear();
         }
 
+        // number of levels read concurrently
+        void set_num_threads(int n){
+            num_threads = (n > 0) ? n : 1;
+        }
+
         ~ConcatLevelFileRetriever(){}
 
         void print() const {
@@ -73,8 +172,9 @@ namespace MDR {
 
         std::vector<std::string> level_files;
         std::string metadata_file;
-        std::vector<uint32_t> offsets;
         std::vector<uint8_t*> concated_level_components;
+        std::shared_ptr<LevelFileHandles> handles;
+        int num_threads = 1;
     };
 }
 #endif
@@ -0,0 +1,145 @@
+#ifndef _MDR_MMAP_FILE_RETRIEVER_HPP
+#define _MDR_MMAP_FILE_RETRIEVER_HPP
+
+#include "RetrieverInterface.hpp"
+#include "FileRetriever.hpp"
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace MDR {
+    // read-only mapping of a whole file
+    class MappedFile {
+    public:
+        MappedFile(const std::string& file){
+            int fd = open(file.c_str(), O_RDONLY);
+            if(fd < 0){
+                std::cerr << "Cannot open " << file << ": " << strerror(errno) << std::endl;
+                return;
+            }
+            struct stat st;
+            if(fstat(fd, &st) == 0) size = st.st_size;
+            if(size){
+                void * addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(addr == MAP_FAILED){
+                    std::cerr << "Cannot map " << file << ": " << strerror(errno) << std::endl;
+                    size = 0;
+                }
+                else{
+                    data = static_cast<uint8_t *>(addr);
+                    // bitplanes are consumed front to back
+                    madvise(data, size, MADV_SEQUENTIAL);
+                }
+            }
+            close(fd);
+        }
+        ~MappedFile(){
+            if(data) munmap(data, size);
+        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // ask the kernel to read [offset, offset + length) ahead of use
+        void will_need(size_t offset, size_t length) const {
+            if((data == NULL) || (length == 0) || (offset >= size)) return;
+            const size_t page_size = sysconf(_SC_PAGESIZE);
+            size_t begin = offset / page_size * page_size;
+            size_t end = std::min(offset + length, size);
+            madvise(data + begin, end - begin, MADV_WILLNEED);
+        }
+
+        uint8_t const * get() const {
+            return data;
+        }
+        size_t get_size() const {
+            return size;
+        }
+    private:
+        uint8_t * data = NULL;
+        size_t size = 0;
+    };
+
+    // level files mapped once, on first use, and shared by all copies of a retriever
+    class LevelFileMappings {
+    public:
+        LevelFileMappings(const std::vector<std::string>& files) : files(files), mappings(files.size()) {}
+        LevelFileMappings(const LevelFileMappings&) = delete;
+        LevelFileMappings& operator=(const LevelFileMappings&) = delete;
+
+        // mapping of file i; copies may retrieve concurrently, e.g. from the background thread of PrefetchRetriever
+        const MappedFile& get(int i){
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!mappings[i]) mappings[i].reset(new MappedFile(files[i]));
+            return *mappings[i];
+        }
+    private:
+        std::vector<std::string> files;
+        std::vector<std::unique_ptr<MappedFile>> mappings;
+        std::mutex mutex;
+    };
+
+    // zero-copy retriever: level files are mapped once and the retrieved components point straight into the mappings;
+    // each step only hints the kernel (MADV_WILLNEED) to fetch the ranges chosen by the size interpreter
+    class MmapLevelFileRetriever : public concepts::LevelRetrieverInterface {
+    public:
+        MmapLevelFileRetriever(const std::string& metadata_file, const std::vector<std::string>& level_files) : metadata_file(metadata_file), level_files(level_files) {
+            mappings = std::make_shared<LevelFileMappings>(level_files);
+        }
+
+        std::vector<std::vector<const uint8_t*>> retrieve_level_components(const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<uint32_t>& retrieve_sizes, const std::vector<uint8_t>& prev_level_num_bitplanes, const std::vector<uint8_t>& level_num_bitplanes){
+            uint32_t total_retrieve_size = 0;
+            std::vector<std::vector<const uint8_t*>> level_components(level_num_bitplanes.size());
+            for(int i=0; i<retrieve_sizes.size(); i++){
+                level_components[i] = retrieve_level(i, level_sizes[i], retrieve_sizes[i], prev_level_num_bitplanes[i], level_num_bitplanes[i]);
+                total_retrieve_size += level_file_offset(level_sizes[i], prev_level_num_bitplanes[i]) + retrieve_sizes[i];
+            }
+            if(retrieve_logging()) std::cout << "Total retrieve size = " << total_retrieve_size << std::endl;
+            return level_components;
+        }
+
+        std::vector<const uint8_t*> retrieve_level(int level, const std::vector<uint32_t>& level_sizes, uint32_t retrieve_size, uint8_t prev_num_bitplanes, uint8_t num_bitplanes){
+            print_retrieve(level, prev_num_bitplanes, num_bitplanes);
+            const MappedFile& file = mappings->get(level);
+            const uint64_t offset = level_file_offset(level_sizes, prev_num_bitplanes);
+            if(offset + retrieve_size > file.get_size()){
+                std::cerr << "Retrieve beyond the end of " << level_files[level] << std::endl;
+                exit(-1);
+            }
+            file.will_need(offset, retrieve_size);
+            std::vector<const uint8_t*> components;
+            const uint8_t * pos = file.get() + offset;
+            for(int j=prev_num_bitplanes; j<num_bitplanes; j++){
+                components.push_back(pos);
+                pos += level_sizes[j];
+            }
+            return components;
+        }
+
+        uint8_t * load_metadata() const {
+            MappedFile file(metadata_file);
+            uint8_t * metadata = (uint8_t *) malloc(file.get_size());
+            memcpy(metadata, file.get(), file.get_size());
+            return metadata;
+        }
+
+        // the mappings stay valid for the lifetime of the retriever
+        void release(){}
+
+        ~MmapLevelFileRetriever(){}
+
+        void print() const {
+            std::cout << "Mmap file retriever." << std::endl;
+        }
+    private:
+        std::string metadata_file;
+        std::vector<std::string> level_files;
+        // shared by copies of the retriever, unmapped with the last one
+        std::shared_ptr<LevelFileMappings> mappings;
+    };
+}
+#endif
@@ -0,0 +1,93 @@
+#ifndef _MDR_PREFETCH_RETRIEVER_HPP
+#define _MDR_PREFETCH_RETRIEVER_HPP
+
+#include <future>
+#include "RetrieverInterface.hpp"
+
+namespace MDR {
+    // Retriever that reads the bitplanes of the next progressive step in the background, see ComposedReconstructor::prefetch_tolerance
+    // two copies of the wrapped retriever take turns: one holds the components of the current step while the other
+    // prefetches; a step that differs from the prediction waits for the prefetch, drops it and is read as usual
+    template<class Retriever>
+    class PrefetchRetriever : public concepts::PrefetchRetrieverInterface {
+    public:
+        PrefetchRetriever(const Retriever& retriever) : retrievers(2, retriever) {}
+        // a copy starts without pending prefetch
+        PrefetchRetriever(const PrefetchRetriever& other) : retrievers(other.retrievers) {}
+        PrefetchRetriever& operator=(const PrefetchRetriever& other){
+            if(this != &other){
+                drop_prefetch();
+                retrievers = other.retrievers;
+                active = 0;
+            }
+            return *this;
+        }
+
+        std::vector<std::vector<const uint8_t*>> retrieve_level_components(const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<uint32_t>& retrieve_sizes, const std::vector<uint8_t>& prev_level_num_bitplanes, const std::vector<uint8_t>& level_num_bitplanes){
+            if(pending.valid()){
+                auto level_components = pending.get();
+                if((pending_prev_num_bitplanes == prev_level_num_bitplanes) && (pending_num_bitplanes == level_num_bitplanes)){
+                    // the background read is reported here, in the order of the caller's output
+                    for(int i=0; i<level_num_bitplanes.size(); i++){
+                        print_retrieve(i, prev_level_num_bitplanes[i], level_num_bitplanes[i]);
+                    }
+                    print_total_retrieve_size(level_sizes, retrieve_sizes, prev_level_num_bitplanes);
+                    if(retrieve_logging()) std::cout << "Served from prefetch" << std::endl;
+                    retrievers[active].release();
+                    active = 1 - active;
+                    prefetched_steps ++;
+                    return level_components;
+                }
+                retrievers[1 - active].release();
+            }
+            return retrievers[active].retrieve_level_components(level_sizes, retrieve_sizes, prev_level_num_bitplanes, level_num_bitplanes);
+        }
+
+        void prefetch(const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<uint32_t>& retrieve_sizes, const std::vector<uint8_t>& prev_level_num_bitplanes, const std::vector<uint8_t>& level_num_bitplanes){
+            drop_prefetch();
+            pending_prev_num_bitplanes = prev_level_num_bitplanes;
+            pending_num_bitplanes = level_num_bitplanes;
+            Retriever * retriever = &retrievers[1 - active];
+            pending = std::async(std::launch::async, [retriever, level_sizes, retrieve_sizes, prev_level_num_bitplanes, level_num_bitplanes](){
+                retrieve_logging() = false;
+                return retriever->retrieve_level_components(level_sizes, retrieve_sizes, prev_level_num_bitplanes, level_num_bitplanes);
+            });
+        }
+
+        uint8_t * load_metadata() const {
+            return retrievers[active].load_metadata();
+        }
+
+        // releases the components of the current step, a prefetched step is kept
+        void release(){
+            retrievers[active].release();
+        }
+
+        // number of steps served from a prefetch
+        size_t get_prefetched_steps() const {
+            return prefetched_steps;
+        }
+
+        ~PrefetchRetriever(){
+            drop_prefetch();
+        }
+
+        void print() const {
+            std::cout << "Prefetching retriever over: "; retrievers[0].print();
+        }
+    private:
+        void drop_prefetch(){
+            if(!pending.valid()) return;
+            pending.get();
+            retrievers[1 - active].release();
+        }
+
+        std::vector<Retriever> retrievers;
+        int active = 0;
+        std::future<std::vector<std::vector<const uint8_t*>>> pending;
+        std::vector<uint8_t> pending_prev_num_bitplanes;
+        std::vector<uint8_t> pending_num_bitplanes;
+        size_t prefetched_steps = 0;
+    };
+}
+#endif
@@ -0,0 +1,145 @@
+#ifndef _MDR_REORGANIZED_FILE_RETRIEVER_HPP
+#define _MDR_REORGANIZED_FILE_RETRIEVER_HPP
+
+#include <algorithm>
+#include "RetrieverInterface.hpp"
+#include "FileRetriever.hpp"
+
+namespace MDR {
+    // Data retriever for files written by ReorganizedFileWriter
+    // the bitplanes of a step are read as maximal contiguous ranges of the file, one pread each;
+    // if the placement follows the retrieval order of the tolerances, every step is a single sequential read
+    class ReorganizedFileRetriever : public concepts::RetrieverInterface {
+    public:
+        ReorganizedFileRetriever(const std::string& metadata_file, const std::string& data_file, int num_threads = 1) : metadata_file(metadata_file), data_file(data_file), num_threads(num_threads) {
+            handles = std::make_shared<LevelFileHandles>(std::vector<std::string>(1, data_file));
+        }
+
+        std::vector<std::vector<const uint8_t*>> retrieve_level_components(const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<uint32_t>& retrieve_sizes, const std::vector<uint8_t>& prev_level_num_bitplanes, const std::vector<uint8_t>& level_num_bitplanes){
+            release();
+            int fd = handles->get(0);
+            if(bitplane_offsets.empty()) load_placement(fd);
+            // bitplanes of this step in file order
+            std::vector<Piece> pieces;
+            for(int i=0; i<retrieve_sizes.size(); i++){
+                print_retrieve(i, prev_level_num_bitplanes[i], level_num_bitplanes[i]);
+                for(int j=prev_level_num_bitplanes[i]; j<level_num_bitplanes[i]; j++){
+                    pieces.push_back({bitplane_offsets[i][j], level_sizes[i][j], i, j});
+                }
+            }
+            std::sort(pieces.begin(), pieces.end(), [](const Piece& a, const Piece& b){
+                return a.offset < b.offset;
+            });
+            // coalesce adjacent bitplanes into ranges
+            std::vector<Range> ranges;
+            uint32_t step_size = 0;
+            for(const auto& piece:pieces){
+                if(ranges.empty() || (ranges.back().offset + ranges.back().size != piece.offset)){
+                    ranges.push_back({piece.offset, 0, step_size});
+                }
+                ranges.back().size += piece.size;
+                step_size += piece.size;
+            }
+            buffer = StreamPool::allocate(step_size);
+            const int num_ranges = ranges.size();
+            bool failed = false;
+            #pragma omp parallel for schedule(dynamic) num_threads(num_threads) if((num_threads > 1) && (num_ranges > 1)) reduction(||:failed)
+            for(int r=0; r<num_ranges; r++){
+                if(read_file_range(fd, buffer + ranges[r].buffer_offset, ranges[r].size, ranges[r].offset) != ranges[r].size){
+                    std::cerr << "Cannot read " << ranges[r].size << " bytes at offset " << ranges[r].offset << " from " << data_file << std::endl;
+                    failed = true;
+                }
+            }
+            if(failed) exit(-1);
+            retrieved_size += step_size;
+            if(retrieve_logging()) std::cout << "Total retrieve size = " << retrieved_size << " in " << num_ranges << " reads" << std::endl;
+
+            std::vector<std::vector<const uint8_t*>> level_components(level_num_bitplanes.size());
+            for(int i=0; i<level_num_bitplanes.size(); i++){
+                level_components[i].resize(level_num_bitplanes[i] - prev_level_num_bitplanes[i]);
+            }
+            size_t pos = 0;
+            for(const auto& piece:pieces){
+                level_components[piece.level][piece.bitplane - prev_level_num_bitplanes[piece.level]] = buffer + pos;
+                pos += piece.size;
+            }
+            return level_components;
+        }
+
+        uint8_t * load_metadata() const {
+            int fd = open(metadata_file.c_str(), O_RDONLY);
+            if(fd < 0){
+                std::cerr << "Cannot open " << metadata_file << ": " << strerror(errno) << std::endl;
+                exit(-1);
+            }
+            struct stat st;
+            fstat(fd, &st);
+            uint32_t num_bytes = st.st_size;
+            uint8_t * metadata = (uint8_t *) malloc(num_bytes);
+            read_file_range(fd, metadata, num_bytes, 0);
+            close(fd);
+            return metadata;
+        }
+
+        void release(){
+            StreamPool::deallocate(buffer);
+            buffer = NULL;
+        }
+
+        // number of ranges read concurrently
+        void set_num_threads(int n){
+            num_threads = (n > 0) ? n : 1;
+        }
+
+        ~ReorganizedFileRetriever(){}
+
+        void print() const {
+            std::cout << "Reorganized file retriever." << std::endl;
+        }
+    private:
+        struct Piece {
+            uint64_t offset;
+            uint32_t size;
+            int level;
+            int bitplane;
+        };
+        struct Range {
+            uint64_t offset;
+            uint32_t size;
+            uint32_t buffer_offset;
+        };
+
+        // read the placement header and locate every bitplane in the file
+        void load_placement(int fd){
+            uint32_t num_bitplanes = 0;
+            if((fd < 0) || (read_file_range(fd, reinterpret_cast<uint8_t *>(&num_bitplanes), sizeof(uint32_t), 0) != sizeof(uint32_t))){
+                std::cerr << "Cannot read the bitplane placement of " << data_file << std::endl;
+                exit(-1);
+            }
+            std::vector<uint8_t> header(num_bitplanes * (sizeof(uint8_t) + sizeof(uint32_t)));
+            if(read_file_range(fd, header.data(), header.size(), sizeof(uint32_t)) != header.size()){
+                std::cerr << "Cannot read the bitplane placement of " << data_file << std::endl;
+                exit(-1);
+            }
+            uint8_t const * order = header.data();
+            uint8_t const * sizes = header.data() + num_bitplanes;
+            uint64_t offset = sizeof(uint32_t) + header.size();
+            for(uint32_t k=0; k<num_bitplanes; k++){
+                uint32_t size = 0;
+                memcpy(&size, sizes + k * sizeof(uint32_t), sizeof(uint32_t));
+                if(bitplane_offsets.size() <= order[k]) bitplane_offsets.resize(order[k] + 1);
+                bitplane_offsets[order[k]].push_back(offset);
+                offset += size;
+            }
+        }
+
+        std::string metadata_file;
+        std::string data_file;
+        std::vector<std::vector<uint64_t>> bitplane_offsets;
+        uint8_t * buffer = NULL;
+        size_t retrieved_size = 0;
+        std::shared_ptr<LevelFileHandles> handles;
+        int num_threads = 1;
+    };
+}
+#endif
@@ -2,5 +2,9 @@
 #define _MDR_RETRIEVER_HPP
 
 #include "FileRetriever.hpp"
+#include "MmapFileRetriever.hpp"
+#include "ContainerFileRetriever.hpp"
+#include "ReorganizedFileRetriever.hpp"
+#include "PrefetchRetriever.hpp"
 
 #endif
@@ -2,8 +2,35 @@
 #define _MDR_RETRIEVER_INTERFACE_HPP
 
 #include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <vector>
 
 namespace MDR {
+    // retrievers report what they read on std::cout unless the calling thread turned it off,
+    // e.g. a thread reading in the background of the reconstruction
+    inline bool& retrieve_logging(){
+        static thread_local bool enabled = true;
+        return enabled;
+    }
+
+    inline void print_retrieve(int level, uint8_t prev_num_bitplanes, uint8_t num_bitplanes){
+        if(retrieve_logging()) std::cout << "Retrieve " << +num_bitplanes << " (" << +(num_bitplanes - prev_num_bitplanes) << " more) bitplanes from level " << level << std::endl;
+    }
+
+    // total size reported after a step: the bitplanes retrieved by the previous steps and the retrieve_sizes of this one
+    inline void print_total_retrieve_size(const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<uint32_t>& retrieve_sizes, const std::vector<uint8_t>& prev_level_num_bitplanes){
+        if(!retrieve_logging()) return;
+        uint64_t total_retrieve_size = 0;
+        for(int i=0; i<retrieve_sizes.size(); i++){
+            for(int j=0; j<prev_level_num_bitplanes[i]; j++){
+                total_retrieve_size += level_sizes[i][j];
+            }
+            total_retrieve_size += retrieve_sizes[i];
+        }
+        std::cout << "Total retrieve size = " << total_retrieve_size << std::endl;
+    }
+
     namespace concepts {
 
         // Error-controlled data retrieval
@@ -20,6 +47,26 @@ namespace MDR {
 
             virtual void print() const = 0;
         };
+
+        // retriever that can read the levels of a progressive step one at a time, so that reading a level
+        // overlaps the processing of the previous ones; the components stay valid until release()
+        class LevelRetrieverInterface : public RetrieverInterface {
+        public:
+
+            virtual ~LevelRetrieverInterface() = default;
+
+            virtual std::vector<const uint8_t*> retrieve_level(int level, const std::vector<uint32_t>& level_sizes, uint32_t retrieve_size, uint8_t prev_num_bitplanes, uint8_t num_bitplanes) = 0;
+        };
+
+        // retriever that can read the bitplanes of a predicted progressive step in the background;
+        // a later retrieve_level_components of the same step is served from them
+        class PrefetchRetrieverInterface : public RetrieverInterface {
+        public:
+
+            virtual ~PrefetchRetrieverInterface() = default;
+
+            virtual void prefetch(const std::vector<std::vector<uint32_t>>& level_sizes, const std::vector<uint32_t>& retrieve_sizes, const std::vector<uint8_t>& prev_level_num_bitplanes, const std::vector<uint8_t>& level_num_bitplanes) = 0;
+        };
     }
 }
 #endif
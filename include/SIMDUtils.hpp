@@ -0,0 +1,41 @@
+#ifndef _MDR_SIMD_UTILS_HPP
+#define _MDR_SIMD_UTILS_HPP
+
+// runtime selection of SIMD kernels; define MDR_NO_SIMD to force the scalar paths
+#if !defined(MDR_NO_SIMD) && defined(__GNUC__) && defined(__x86_64__)
+#define MDR_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace MDR {
+
+    enum SIMDLevel {SIMD_SCALAR = 0, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512};
+
+    inline SIMDLevel detect_simd_level(){
+#ifdef MDR_X86_SIMD
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+        if(__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+        if(__builtin_cpu_supports("sse2")) return SIMD_SSE2;
+#endif
+        return SIMD_SCALAR;
+    }
+
+    // detected once per process
+    inline SIMDLevel simd_level(){
+        static const SIMDLevel level = detect_simd_level();
+        return level;
+    }
+
+    // AVX-512DQ provides the 64-bit integer <-> double conversions
+    inline bool simd_has_avx512dq(){
+#ifdef MDR_X86_SIMD
+        static const bool supported = (simd_level() == SIMD_AVX512) && __builtin_cpu_supports("avx512dq");
+        return supported;
+#else
+        return false;
+#endif
+    }
+
+}
+#endif
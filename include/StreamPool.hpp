@@ -0,0 +1,206 @@
+#ifndef _MDR_STREAM_POOL_HPP
+#define _MDR_STREAM_POOL_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <iostream>
+
+namespace MDR {
+    // pool of bitplane stream buffers shared by the encoders, lossless compressors, writers and refactors
+    // sizes are rounded up to size classes (four per power of two) and released buffers are kept on per-class free lists,
+    // so refactoring many blocks or timesteps reuses the same memory instead of going through malloc/mmap for every stream;
+    // each buffer records its size class in a header, so it can be returned from any thread
+    class StreamPool {
+    public:
+        // buffer of at least size bytes, 16-byte aligned
+        static uint8_t * allocate(size_t size){
+            return instance().allocate_buffer(size);
+        }
+
+        // return a buffer obtained from allocate(); NULL is ignored
+        static void deallocate(void const * ptr){
+            if(ptr) instance().deallocate_buffer(const_cast<void *>(ptr));
+        }
+
+        // usable size of a buffer obtained from allocate()
+        static size_t capacity(void const * ptr){
+            return class_capacity(header(const_cast<void *>(ptr))->size_class);
+        }
+
+        // free all cached buffers at once; buffers in use are not affected
+        static void release(){
+            instance().release_cached();
+        }
+
+        // bytes held on the free lists
+        static size_t cached_bytes(){
+            return instance().cached;
+        }
+
+        // released buffers beyond this many cached bytes are freed immediately;
+        // the default covers the streams of a large level, anything above it goes back to the system
+        static const size_t DEFAULT_MAX_CACHED_BYTES = (size_t) 256 << 20;
+        static void set_max_cached_bytes(size_t bytes){
+            instance().max_cached = bytes;
+        }
+
+    private:
+        struct Header {
+            uint32_t size_class;
+            uint32_t magic;
+            uint64_t padding;
+        };
+        struct SizeClass {
+            std::mutex mutex;
+            std::vector<void *> free_blocks;
+        };
+        static const int MIN_EXP = 6;           // smallest class: 64 bytes
+        static const int NUM_CLASSES = 4 * (64 - MIN_EXP);
+        static const uint32_t MAGIC = 0x4d445250;
+
+        StreamPool() : classes(NUM_CLASSES) {}
+
+        // the pool outlives every static object that may still return buffers at exit
+        static StreamPool& instance(){
+            static StreamPool * pool = new StreamPool();
+            return *pool;
+        }
+
+        static Header * header(void * ptr){
+            Header * h = reinterpret_cast<Header *>(ptr) - 1;
+            if(h->magic != MAGIC){
+                std::cerr << "StreamPool: buffer was not allocated from the pool" << std::endl;
+                exit(-1);
+            }
+            return h;
+        }
+
+        // capacities 2^e * {4, 5, 6, 7} / 4
+        static size_t class_capacity(uint32_t c){
+            int e = MIN_EXP + c / 4;
+            return ((size_t) 1 << e) + (c % 4) * ((size_t) 1 << (e - 2));
+        }
+
+        static uint32_t size_class(size_t size){
+            if(size <= ((size_t) 1 << MIN_EXP)) return 0;
+            int e = 0;
+            while((e < 63) && (((size_t) 1 << (e + 1)) <= size)) e++;
+            size_t step = (size_t) 1 << (e - 2);
+            size_t m = (size - ((size_t) 1 << e) + step - 1) / step;
+            if(m == 4){
+                e ++;
+                m = 0;
+            }
+            return (e - MIN_EXP) * 4 + m;
+        }
+
+        uint8_t * allocate_buffer(size_t size){
+            uint32_t c = size_class(size);
+            void * block = NULL;
+            {
+                std::lock_guard<std::mutex> lock(classes[c].mutex);
+                if(classes[c].free_blocks.size()){
+                    block = classes[c].free_blocks.back();
+                    classes[c].free_blocks.pop_back();
+                }
+            }
+            if(block){
+                cached -= class_capacity(c);
+            }
+            else{
+                block = malloc(sizeof(Header) + class_capacity(c));
+                if(block == NULL){
+                    std::cerr << "StreamPool: cannot allocate " << size << " bytes" << std::endl;
+                    exit(-1);
+                }
+                Header * h = reinterpret_cast<Header *>(block);
+                h->size_class = c;
+                h->magic = MAGIC;
+            }
+            return reinterpret_cast<uint8_t *>(reinterpret_cast<Header *>(block) + 1);
+        }
+
+        void deallocate_buffer(void * ptr){
+            Header * h = header(ptr);
+            uint32_t c = h->size_class;
+            if(cached.fetch_add(class_capacity(c)) + class_capacity(c) > max_cached){
+                cached -= class_capacity(c);
+                free(h);
+                return;
+            }
+            std::lock_guard<std::mutex> lock(classes[c].mutex);
+            classes[c].free_blocks.push_back(h);
+        }
+
+        void release_cached(){
+            for(uint32_t c=0; c<classes.size(); c++){
+                std::vector<void *> blocks;
+                {
+                    std::lock_guard<std::mutex> lock(classes[c].mutex);
+                    blocks.swap(classes[c].free_blocks);
+                }
+                for(auto block:blocks){
+                    free(block);
+                }
+                cached -= blocks.size() * class_capacity(c);
+            }
+        }
+
+        std::vector<SizeClass> classes;
+        std::atomic<size_t> cached{0};
+        std::atomic<size_t> max_cached{DEFAULT_MAX_CACHED_BYTES};
+    };
+
+    // move-only owner of a StreamPool buffer
+    class StreamBuffer {
+    public:
+        StreamBuffer(){}
+        explicit StreamBuffer(size_t size) : ptr(StreamPool::allocate(size)) {}
+        // take ownership of a buffer obtained from StreamPool::allocate()
+        static StreamBuffer adopt(uint8_t * buffer){
+            StreamBuffer b;
+            b.ptr = buffer;
+            return b;
+        }
+        StreamBuffer(StreamBuffer&& other) : ptr(other.ptr) {
+            other.ptr = NULL;
+        }
+        StreamBuffer& operator=(StreamBuffer&& other){
+            if(this != &other){
+                reset();
+                ptr = other.ptr;
+                other.ptr = NULL;
+            }
+            return *this;
+        }
+        StreamBuffer(const StreamBuffer&) = delete;
+        StreamBuffer& operator=(const StreamBuffer&) = delete;
+        ~StreamBuffer(){
+            reset();
+        }
+
+        uint8_t * get() const {
+            return ptr;
+        }
+        // give up ownership without returning the buffer to the pool
+        uint8_t * release(){
+            uint8_t * buffer = ptr;
+            ptr = NULL;
+            return buffer;
+        }
+        void reset(){
+            StreamPool::deallocate(ptr);
+            ptr = NULL;
+        }
+        explicit operator bool() const {
+            return ptr != NULL;
+        }
+    private:
+        uint8_t * ptr = NULL;
+    };
+}
+#endif
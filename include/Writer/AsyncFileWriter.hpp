@@ -0,0 +1,77 @@
+#ifndef _MDR_ASYNC_FILE_WRITER_HPP
+#define _MDR_ASYNC_FILE_WRITER_HPP
+
+#include "WriterInterface.hpp"
+#include "SegmentFileIO.hpp"
+#include "AsyncWriteQueue.hpp"
+#include "StreamPool.hpp"
+
+namespace MDR {
+    // A writer of concatenated level files, as ConcatLevelFileWriter, that persists every level on a background I/O thread
+    // as soon as it is encoded; the refactor keeps encoding the other levels meanwhile
+    class AsyncLevelFileWriter : public concepts::LevelStreamWriterInterface {
+    public:
+        // queue may be shared with other writers, e.g. those of all blocks
+        AsyncLevelFileWriter(const std::string& metadata_file, const std::vector<std::string>& level_files, std::shared_ptr<AsyncWriteQueue> queue, const FileWriteOptions& options = FileWriteOptions()) : metadata_file(metadata_file), level_files(level_files), queue(queue), options(options) {
+            tracker = std::make_shared<WriteTracker>();
+        }
+
+        void write_level(int level, std::vector<StreamBuffer>&& components, const std::vector<uint32_t>& sizes) const {
+            // the job owns the streams until it has written them
+            auto streams = std::make_shared<std::vector<StreamBuffer>>(std::move(components));
+            size_t bytes = 0;
+            for(int j=0; j<streams->size(); j++){
+                bytes += sizes[j];
+            }
+            std::vector<uint32_t> segment_sizes(sizes.begin(), sizes.begin() + streams->size());
+            std::string file = level_files[level];
+            FileWriteOptions file_options = options;
+            std::shared_ptr<WriteTracker> level_tracker = tracker;
+            level_tracker->add();
+            queue->push([streams, segment_sizes, file, file_options, level_tracker](){
+                std::vector<const uint8_t*> segments;
+                for(const auto& stream:*streams){
+                    segments.push_back(stream.get());
+                }
+                level_tracker->done(write_file_segments(file, segments, segment_sizes, file_options));
+            }, bytes);
+        }
+
+        std::vector<uint32_t> finish_levels(int num_levels) const {
+            if(!tracker->wait()){
+                std::cerr << "Errors while writing level files" << std::endl;
+                exit(-1);
+            }
+            return std::vector<uint32_t>(num_levels, 1);
+        }
+
+        // synchronous path for callers that hand over all levels at once
+        std::vector<uint32_t> write_level_components(const std::vector<std::vector<uint8_t*>>& level_components, const std::vector<std::vector<uint32_t>>& level_sizes) const {
+            std::vector<uint32_t> level_num;
+            for(int i=0; i<level_components.size(); i++){
+                std::vector<const uint8_t*> segments(level_components[i].begin(), level_components[i].end());
+                std::vector<uint32_t> sizes(level_sizes[i].begin(), level_sizes[i].begin() + level_components[i].size());
+                if(!write_file_segments(level_files[i], segments, sizes, options)) exit(-1);
+                level_num.push_back(1);
+            }
+            return level_num;
+        }
+
+        void write_metadata(uint8_t const * metadata, uint32_t size) const {
+            if(!write_file_segments(metadata_file, std::vector<const uint8_t*>(1, metadata), std::vector<uint32_t>(1, size), options)) exit(-1);
+        }
+
+        ~AsyncLevelFileWriter(){}
+
+        void print() const {
+            std::cout << "Asynchronous file writer." << std::endl;
+        }
+    private:
+        std::string metadata_file;
+        std::vector<std::string> level_files;
+        std::shared_ptr<AsyncWriteQueue> queue;
+        std::shared_ptr<WriteTracker> tracker;
+        FileWriteOptions options;
+    };
+}
+#endif
@@ -0,0 +1,127 @@
+#ifndef _MDR_ASYNC_WRITE_QUEUE_HPP
+#define _MDR_ASYNC_WRITE_QUEUE_HPP
+
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+namespace MDR {
+    // bounded queue of write jobs run by background I/O threads
+    // producers block while the queued jobs hold more than max_queued_bytes, so buffers waiting to be written stay capped;
+    // one queue can be shared by the writers of all blocks
+    class AsyncWriteQueue {
+    public:
+        /*
+            @params max_queued_bytes: bytes of pending jobs before push() blocks; a single larger job is still accepted
+            @params num_io_threads: number of jobs written concurrently
+        */
+        AsyncWriteQueue(size_t max_queued_bytes = 256 << 20, int num_io_threads = 1) : max_queued_bytes(max_queued_bytes) {
+            for(int i=0; i<std::max(num_io_threads, 1); i++){
+                workers.push_back(std::thread([this](){
+                    run();
+                }));
+            }
+        }
+        // waits for the queued jobs
+        ~AsyncWriteQueue(){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            job_available.notify_all();
+            for(auto& worker:workers){
+                worker.join();
+            }
+        }
+        AsyncWriteQueue(const AsyncWriteQueue&) = delete;
+        AsyncWriteQueue& operator=(const AsyncWriteQueue&) = delete;
+
+        // queue job, which holds bytes of buffers until it has run
+        void push(std::function<void()> job, size_t bytes){
+            std::unique_lock<std::mutex> lock(mutex);
+            space_available.wait(lock, [&](){
+                return (queued_bytes == 0) || (queued_bytes + bytes <= max_queued_bytes);
+            });
+            queued_bytes += bytes;
+            jobs.push_back(Job{std::move(job), bytes});
+            job_available.notify_one();
+        }
+
+        size_t get_max_queued_bytes() const {
+            return max_queued_bytes;
+        }
+    private:
+        struct Job {
+            std::function<void()> func;
+            size_t bytes;
+        };
+
+        void run(){
+            while(true){
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    job_available.wait(lock, [&](){
+                        return stopping || !jobs.empty();
+                    });
+                    if(jobs.empty()) return;
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+                job.func();
+                // release the buffers of the job before making room for more
+                job.func = nullptr;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    queued_bytes -= job.bytes;
+                }
+                space_available.notify_all();
+            }
+        }
+
+        size_t max_queued_bytes;
+        size_t queued_bytes = 0;
+        bool stopping = false;
+        std::deque<Job> jobs;
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable job_available;
+        std::condition_variable space_available;
+    };
+
+    // completion of the jobs of one writer
+    class WriteTracker {
+    public:
+        void add(){
+            std::lock_guard<std::mutex> lock(mutex);
+            pending ++;
+        }
+        void done(bool success){
+            std::lock_guard<std::mutex> lock(mutex);
+            pending --;
+            if(!success) failed = true;
+            if(pending == 0) finished.notify_all();
+        }
+        // wait for all jobs; returns false if any failed
+        bool wait(){
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&](){
+                return pending == 0;
+            });
+            bool success = !failed;
+            failed = false;
+            return success;
+        }
+    private:
+        int pending = 0;
+        bool failed = false;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+}
+#endif
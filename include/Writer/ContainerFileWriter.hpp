@@ -0,0 +1,226 @@
+#ifndef _MDR_CONTAINER_FILE_WRITER_HPP
+#define _MDR_CONTAINER_FILE_WRITER_HPP
+
+#include <memory>
+#include <mutex>
+#include "WriterInterface.hpp"
+#include "SegmentFileIO.hpp"
+#include "ContainerFormat.hpp"
+#include "StreamPool.hpp"
+
+namespace MDR {
+    // one container file shared by the writers of all blocks
+    // block-major: segments are appended concurrently, space is reserved under a lock and written with pwritev outside of it;
+    // plane-major: the bitplanes of every block are staged in memory (the compressed size of the data) and laid out by close(),
+    // so that a progressive step of all blocks reads one range per level;
+    // close() appends the footer index
+    class ContainerFileBuilder {
+    public:
+        ContainerFileBuilder(const std::string& path, ContainerLayout layout = CONTAINER_BLOCK_MAJOR) : path(path), layout(layout) {
+            fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(fd < 0){
+                std::cerr << "Cannot open " << path << " for writing: " << strerror(errno) << std::endl;
+                exit(-1);
+            }
+            uint8_t header[ContainerIndex::HEADER_SIZE];
+            uint8_t * header_pos = header;
+            ContainerIndex::put<uint32_t>(ContainerIndex::MAGIC, header_pos);
+            ContainerIndex::put<uint32_t>(ContainerIndex::VERSION, header_pos);
+            ContainerIndex::put<uint32_t>(layout, header_pos);
+            write(std::vector<const uint8_t*>(1, header), std::vector<uint32_t>(1, ContainerIndex::HEADER_SIZE));
+        }
+        // a container left without its index cannot be read, close() has reported why
+        ~ContainerFileBuilder(){
+            if(!close()) exit(-1);
+        }
+        ContainerFileBuilder(const ContainerFileBuilder&) = delete;
+        ContainerFileBuilder& operator=(const ContainerFileBuilder&) = delete;
+
+        // store the level components of block b, replacing earlier ones
+        void write_levels(uint32_t b, const std::vector<std::vector<const uint8_t*>>& level_components, const std::vector<std::vector<uint32_t>>& level_sizes){
+            std::vector<ContainerLevelEntry> levels(level_components.size());
+            for(int i=0; i<level_components.size(); i++){
+                levels[i].sizes = std::vector<uint32_t>(level_sizes[i].begin(), level_sizes[i].begin() + level_components[i].size());
+            }
+            if(layout == CONTAINER_PLANE_MAJOR){
+                // the streams are released by the refactor, keep copies until close()
+                std::vector<std::vector<StreamBuffer>> staged(level_components.size());
+                for(int i=0; i<level_components.size(); i++){
+                    for(int j=0; j<level_components[i].size(); j++){
+                        staged[i].push_back(StreamBuffer(levels[i].sizes[j]));
+                        memcpy(staged[i][j].get(), level_components[i][j], levels[i].sizes[j]);
+                    }
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                if(staged_levels.size() <= b) staged_levels.resize(b + 1);
+                staged_levels[b] = std::move(staged);
+                entry(b).levels = levels;
+                return;
+            }
+            std::vector<const uint8_t*> segments;
+            std::vector<uint32_t> sizes;
+            for(int i=0; i<level_components.size(); i++){
+                segments.insert(segments.end(), level_components[i].begin(), level_components[i].end());
+                sizes.insert(sizes.end(), levels[i].sizes.begin(), levels[i].sizes.end());
+            }
+            uint64_t offset = write(segments, sizes);
+            for(auto& level:levels){
+                for(const auto& size:level.sizes){
+                    level.offsets.push_back(offset);
+                    offset += size;
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            entry(b).levels = levels;
+        }
+
+        // store the metadata of block b, replacing earlier metadata
+        void write_metadata(uint32_t b, uint8_t const * metadata, uint32_t size){
+            uint64_t offset = write(std::vector<const uint8_t*>(1, metadata), std::vector<uint32_t>(1, size));
+            std::lock_guard<std::mutex> lock(mutex);
+            entry(b).metadata_offset = offset;
+            entry(b).metadata_size = size;
+        }
+
+        // append the footer index and close the file; later writes are errors
+        bool close(){
+            std::lock_guard<std::mutex> lock(mutex);
+            if(fd < 0) return true;
+            bool success = true;
+            if(layout == CONTAINER_PLANE_MAJOR) success = write_plane_major();
+            uint32_t index_size = index.serialized_size();
+            std::vector<uint8_t> footer(index_size + ContainerIndex::TRAILER_SIZE);
+            uint8_t * footer_pos = footer.data();
+            index.serialize(footer_pos);
+            ContainerIndex::put<uint64_t>(end, footer_pos);
+            ContainerIndex::put<uint32_t>(index_size, footer_pos);
+            ContainerIndex::put<uint32_t>(ContainerIndex::MAGIC, footer_pos);
+            if(!write_segments_at(fd, std::vector<const uint8_t*>(1, footer.data()), std::vector<uint32_t>(1, footer.size()), end)) success = false;
+            if(::close(fd)) success = false;
+            fd = -1;
+            if(!success) std::cerr << "Errors while writing " << path << ": " << strerror(errno) << std::endl;
+            return success;
+        }
+
+        const std::string& get_path() const {
+            return path;
+        }
+    private:
+        // reserve aligned space at the end of the file and write the segments there; returns their offset
+        uint64_t write(const std::vector<const uint8_t*>& segments, const std::vector<uint32_t>& sizes){
+            uint64_t total_size = 0;
+            for(const auto& size:sizes){
+                total_size += size;
+            }
+            uint64_t offset = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(fd < 0){
+                    std::cerr << "Container " << path << " is already closed" << std::endl;
+                    exit(-1);
+                }
+                offset = align(end);
+                end = offset + total_size;
+            }
+            if(!write_segments_at(fd, segments, sizes, offset)){
+                std::cerr << "Errors while writing " << path << ": " << strerror(errno) << std::endl;
+                exit(-1);
+            }
+            return offset;
+        }
+
+        // lay out the staged bitplanes plane by plane across blocks with one vectored write; called under the lock
+        bool write_plane_major(){
+            static const uint8_t padding[ContainerIndex::SEGMENT_ALIGNMENT] = {0};
+            std::vector<const uint8_t*> segments;
+            std::vector<uint32_t> sizes;
+            const uint64_t start = align(end);
+            uint64_t offset = start;
+            auto append = [&](const uint8_t * segment, uint32_t size){
+                uint64_t aligned = align(offset);
+                if(aligned > offset){
+                    segments.push_back(padding);
+                    sizes.push_back(aligned - offset);
+                }
+                segments.push_back(segment);
+                sizes.push_back(size);
+                offset = aligned + size;
+                return aligned;
+            };
+            size_t max_levels = 0, max_bitplanes = 0;
+            for(const auto& block:index.blocks){
+                max_levels = std::max(max_levels, block.levels.size());
+                for(const auto& level:block.levels){
+                    max_bitplanes = std::max(max_bitplanes, level.sizes.size());
+                }
+            }
+            for(int i=0; i<max_levels; i++){
+                for(int j=0; j<max_bitplanes; j++){
+                    for(uint32_t b=0; b<index.blocks.size(); b++){
+                        if((i >= index.blocks[b].levels.size()) || (j >= index.blocks[b].levels[i].sizes.size())) continue;
+                        ContainerLevelEntry& level = index.blocks[b].levels[i];
+                        level.offsets.resize(level.sizes.size());
+                        level.offsets[j] = append(staged_levels[b][i][j].get(), level.sizes[j]);
+                    }
+                }
+            }
+            bool success = write_segments_at(fd, segments, sizes, start);
+            end = offset;
+            staged_levels.clear();
+            return success;
+        }
+
+        static uint64_t align(uint64_t offset){
+            return (offset + ContainerIndex::SEGMENT_ALIGNMENT - 1) / ContainerIndex::SEGMENT_ALIGNMENT * ContainerIndex::SEGMENT_ALIGNMENT;
+        }
+
+        ContainerBlockEntry& entry(uint32_t b){
+            if(index.blocks.size() <= b) index.blocks.resize(b + 1);
+            return index.blocks[b];
+        }
+
+        std::string path;
+        ContainerLayout layout;
+        int fd = -1;
+        uint64_t end = 0;
+        ContainerIndex index;
+        // plane-major only: bitplanes of each block until close()
+        std::vector<std::vector<std::vector<StreamBuffer>>> staged_levels;
+        std::mutex mutex;
+    };
+
+    // writer of one block into a shared container file, replacing the metadata and level files of the block
+    class ContainerFileWriter : public concepts::WriterInterface {
+    public:
+        ContainerFileWriter(std::shared_ptr<ContainerFileBuilder> container, uint32_t block_id=0) : container(container), block_id(block_id) {}
+
+        // writer of another block of the same container
+        ContainerFileWriter for_block(uint32_t b) const {
+            return ContainerFileWriter(container, b);
+        }
+
+        // block-major: all levels of the block are written with one vectored write
+        std::vector<uint32_t> write_level_components(const std::vector<std::vector<uint8_t*>>& level_components, const std::vector<std::vector<uint32_t>>& level_sizes) const {
+            std::vector<std::vector<const uint8_t*>> components;
+            for(const auto& level:level_components){
+                components.push_back(std::vector<const uint8_t*>(level.begin(), level.end()));
+            }
+            container->write_levels(block_id, components, level_sizes);
+            return std::vector<uint32_t>(level_components.size(), 1);
+        }
+
+        void write_metadata(uint8_t const * metadata, uint32_t size) const {
+            container->write_metadata(block_id, metadata, size);
+        }
+
+        ~ContainerFileWriter(){}
+
+        void print() const {
+            std::cout << "Container file writer." << std::endl;
+        }
+    private:
+        std::shared_ptr<ContainerFileBuilder> container;
+        uint32_t block_id;
+    };
+}
+#endif
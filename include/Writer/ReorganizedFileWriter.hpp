@@ -0,0 +1,66 @@
+#ifndef _MDR_REORGANIZED_FILE_WRITER_HPP
+#define _MDR_REORGANIZED_FILE_WRITER_HPP
+
+#include "WriterInterface.hpp"
+#include "SegmentFileIO.hpp"
+
+namespace MDR {
+    // A writer that stores all levels in one file with the bitplanes in the placement order of a reorganizer
+    // file: u32 number of bitplanes, u8 level of each bitplane, u32 size of each bitplane, then the bitplanes in that order
+    template<class Reorganizer>
+    class ReorganizedFileWriter : public concepts::ErrorAwareWriterInterface {
+    public:
+        ReorganizedFileWriter(const std::string& metadata_file, const std::string& data_file, const Reorganizer& reorganizer, const FileWriteOptions& options = FileWriteOptions()) : metadata_file(metadata_file), data_file(data_file), reorganizer(reorganizer), options(options) {}
+
+        void set_level_errors(const std::vector<double>& level_error_bounds_, const std::vector<std::vector<double>>& level_squared_errors_){
+            level_error_bounds = level_error_bounds_;
+            level_squared_errors = level_squared_errors_;
+        }
+
+        // placement header and bitplanes are written with one vectored write straight from the bitplane buffers
+        std::vector<uint32_t> write_level_components(const std::vector<std::vector<uint8_t*>>& level_components, const std::vector<std::vector<uint32_t>>& level_sizes) const {
+            std::vector<std::vector<uint32_t>> stored_sizes;
+            for(int i=0; i<level_components.size(); i++){
+                stored_sizes.push_back(std::vector<uint32_t>(level_sizes[i].begin(), level_sizes[i].begin() + level_components[i].size()));
+            }
+            auto order = reorganizer.placement_order(stored_sizes, level_error_bounds, level_squared_errors);
+            const uint32_t num_bitplanes = order.size();
+            std::vector<uint8_t> header(sizeof(uint32_t) + num_bitplanes * (sizeof(uint8_t) + sizeof(uint32_t)));
+            uint8_t * header_pos = header.data();
+            memcpy(header_pos, &num_bitplanes, sizeof(uint32_t));
+            header_pos += sizeof(uint32_t);
+            memcpy(header_pos, order.data(), num_bitplanes);
+            header_pos += num_bitplanes;
+            std::vector<const uint8_t*> segments(1, header.data());
+            std::vector<uint32_t> sizes(1, header.size());
+            std::vector<int> next(level_components.size(), 0);
+            for(const auto& i:order){
+                int j = next[i] ++;
+                memcpy(header_pos, &stored_sizes[i][j], sizeof(uint32_t));
+                header_pos += sizeof(uint32_t);
+                segments.push_back(level_components[i][j]);
+                sizes.push_back(stored_sizes[i][j]);
+            }
+            if(!write_file_segments(data_file, segments, sizes, options)) exit(-1);
+            return std::vector<uint32_t>(level_components.size(), 1);
+        }
+
+        void write_metadata(uint8_t const * metadata, uint32_t size) const {
+            if(!write_file_segments(metadata_file, std::vector<const uint8_t*>(1, metadata), std::vector<uint32_t>(1, size), options)) exit(-1);
+        }
+
+        ~ReorganizedFileWriter(){}
+
+        void print() const {
+            std::cout << "Reorganized file writer: "; reorganizer.print();
+        }
+    private:
+        std::string metadata_file;
+        std::string data_file;
+        Reorganizer reorganizer;
+        FileWriteOptions options;
+        std::vector<double> level_error_bounds;
+        std::vector<std::vector<double>> level_squared_errors;
+    };
+}
+#endif
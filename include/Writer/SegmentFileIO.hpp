@@ -0,0 +1,149 @@
+#ifndef _MDR_SEGMENT_FILE_IO_HPP
+#define _MDR_SEGMENT_FILE_IO_HPP
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+namespace MDR {
+    // how level files are written
+    struct FileWriteOptions {
+        bool preallocate = false;       // reserve the file size with posix_fallocate before writing (glibc emulates it
+                                        // with small writes on file systems without fallocate support)
+        bool direct_io = false;         // bypass the page cache with O_DIRECT, staging through aligned buffers
+        size_t alignment = 4096;        // O_DIRECT alignment of buffers, offsets and sizes
+        size_t staging_size = 4 << 20;  // O_DIRECT staging buffer size, a multiple of alignment
+    };
+
+    // write segments back to back at offset of an open file with pwritev, straight from the segment buffers
+    // returns false on failure
+    inline bool write_segments_at(int fd, const std::vector<const uint8_t*>& segments, const std::vector<uint32_t>& sizes, off_t offset){
+        std::vector<struct iovec> iov;
+        for(int i=0; i<segments.size(); i++){
+            if(sizes[i]) iov.push_back({const_cast<uint8_t *>(segments[i]), sizes[i]});
+        }
+        size_t iov_index = 0;
+        while(iov_index < iov.size()){
+            int count = std::min<size_t>(iov.size() - iov_index, IOV_MAX);
+            ssize_t written = pwritev(fd, iov.data() + iov_index, count, offset);
+            if(written < 0){
+                if(errno == EINTR) continue;
+                return false;
+            }
+            offset += written;
+            // skip fully written segments and advance into a partially written one
+            while((iov_index < iov.size()) && (written >= (ssize_t) iov[iov_index].iov_len)){
+                written -= iov[iov_index].iov_len;
+                iov_index ++;
+            }
+            if(written > 0){
+                iov[iov_index].iov_base = static_cast<uint8_t *>(iov[iov_index].iov_base) + written;
+                iov[iov_index].iov_len -= written;
+            }
+        }
+        return true;
+    }
+
+    // write segments back to back into path with pwritev, straight from the segment buffers
+    /*
+        @params path: file to create or truncate
+        @params segments: buffers to write in order
+        @params sizes: size of each segment
+        @params options: preallocation and O_DIRECT settings; O_DIRECT falls back to buffered writes if the file system refuses it
+        returns false on failure
+    */
+    inline bool write_file_segments(const std::string& path, const std::vector<const uint8_t*>& segments, const std::vector<uint32_t>& sizes, const FileWriteOptions& options = FileWriteOptions()){
+        size_t total_size = 0;
+        for(const auto& size:sizes){
+            total_size += size;
+        }
+        int fd = -1;
+        bool direct = false;
+#ifdef O_DIRECT
+        if(options.direct_io && (options.alignment > 0) && (options.staging_size >= options.alignment)){
+            fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+            direct = (fd >= 0);
+        }
+#endif
+        if(fd < 0) fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0){
+            std::cerr << "Cannot open " << path << " for writing: " << strerror(errno) << std::endl;
+            return false;
+        }
+        // not every file system supports preallocation; it is only a hint
+        if(options.preallocate && total_size) posix_fallocate(fd, 0, total_size);
+
+        bool success = true;
+        if(!direct){
+            success = write_segments_at(fd, segments, sizes, 0);
+        }
+        else{
+            // O_DIRECT needs aligned buffers, offsets and sizes: pack segments into an aligned staging buffer,
+            // pad the last chunk to the alignment and cut the file back to its size
+            const size_t alignment = options.alignment;
+            const size_t staging_size = options.staging_size / alignment * alignment;
+            void * staging = NULL;
+            if(posix_memalign(&staging, alignment, staging_size)){
+                std::cerr << "Cannot allocate O_DIRECT staging buffer" << std::endl;
+                close(fd);
+                return false;
+            }
+            uint8_t * staging_pos = static_cast<uint8_t *>(staging);
+            size_t filled = 0;
+            off_t offset = 0;
+            auto flush = [&](size_t length){
+                size_t done = 0;
+                while(done < length){
+                    ssize_t written = pwrite(fd, staging_pos + done, length - done, offset + done);
+                    if((written < 0) && (errno == EINTR)) continue;
+                    if(written <= 0){
+                        if(written == 0) errno = EIO;
+                        return false;
+                    }
+                    done += written;
+#ifdef O_DIRECT
+                    // O_DIRECT refuses the unaligned rest of a short write: finish the file through the page cache
+                    if((done < length) && (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT) < 0)) return false;
+#endif
+                }
+                offset += length;
+                return true;
+            };
+            for(int i=0; (i<segments.size()) && success; i++){
+                size_t copied = 0;
+                while(copied < sizes[i]){
+                    size_t length = std::min<size_t>(sizes[i] - copied, staging_size - filled);
+                    memcpy(staging_pos + filled, segments[i] + copied, length);
+                    filled += length;
+                    copied += length;
+                    if(filled == staging_size){
+                        if(!flush(staging_size)){
+                            success = false;
+                            break;
+                        }
+                        filled = 0;
+                    }
+                }
+            }
+            if(success && filled){
+                size_t padded = (filled + alignment - 1) / alignment * alignment;
+                memset(staging_pos + filled, 0, padded - filled);
+                success = flush(padded) && (ftruncate(fd, total_size) == 0);
+            }
+            free(staging);
+        }
+        if(close(fd)) success = false;
+        if(!success) std::cerr << "Errors while writing " << path << ": " << strerror(errno) << std::endl;
+        return success;
+    }
+}
+#endif
@@ -3,5 +3,8 @@
 
 #include "FileWriter.hpp"
 #include "HPSSFileWriter.hpp"
+#include "ContainerFileWriter.hpp"
+#include "ReorganizedFileWriter.hpp"
+#include "AsyncFileWriter.hpp"
 
 #endif
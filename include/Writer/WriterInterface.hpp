@@ -1,6 +1,8 @@
 #ifndef _MDR_WRITER_INTERFACE_HPP
 #define _MDR_WRITER_INTERFACE_HPP
 
+#include "StreamPool.hpp"
+
 namespace MDR {
     namespace concepts {
 
@@ -16,6 +18,24 @@ namespace MDR {
 
             virtual void print() const = 0;
         };
+
+        // writer that receives the level errors before the level components, e.g. to place bitplanes in retrieval order
+        class ErrorAwareWriterInterface : public WriterInterface {
+        public:
+
+            virtual void set_level_errors(const std::vector<double>& level_error_bounds, const std::vector<std::vector<double>>& level_squared_errors) = 0;
+        };
+
+        // writer that takes every level as soon as it is encoded, e.g. to persist it while the next levels are encoded
+        class LevelStreamWriterInterface : public WriterInterface {
+        public:
+
+            // takes over the stream buffers of level; may be called concurrently for different levels
+            virtual void write_level(int level, std::vector<StreamBuffer>&& components, const std::vector<uint32_t>& sizes) const = 0;
+
+            // wait until the levels are stored; returns what write_level_components would
+            virtual std::vector<uint32_t> finish_levels(int num_levels) const = 0;
+        };
     }
 }
 #endif
@@ -0,0 +1,153 @@
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+#include "Writer/Writer.hpp"
+
+// Stress test of the asynchronous writer, meant to be run under
+// -fsanitize=thread: several producers share one bounded AsyncWriteQueue, and
+// the level files written by AsyncLevelFileWriter are compared with the
+// streams handed to it
+
+using namespace std;
+
+// deterministic content of stream j of level l of block b
+vector<uint8_t> make_stream(int b, int l, int j) {
+  vector<uint8_t> stream(1 + (b * 131 + l * 71 + j * 17) % 5000);
+  for (size_t i = 0; i < stream.size(); i++) {
+    stream[i] = (uint8_t)(b * 7 + l * 13 + j * 29 + i);
+  }
+  return stream;
+}
+
+// several producers push jobs of random sizes; the bytes held by pending jobs
+// never exceed the queue limit and every job runs once
+bool test_queue(int num_producers, int num_jobs, size_t max_queued_bytes,
+                int num_io_threads) {
+  atomic<long> executed{0};
+  atomic<long> held{0};
+  atomic<long> max_held{0};
+  {
+    MDR::AsyncWriteQueue queue(max_queued_bytes, num_io_threads);
+    vector<thread> producers;
+    for (int p = 0; p < num_producers; p++) {
+      producers.push_back(thread([&, p]() {
+        MDR::WriteTracker tracker;
+        for (int i = 0; i < num_jobs; i++) {
+          long bytes = 1 + (i * 37 + p * 11) % max_queued_bytes;
+          tracker.add();
+          queue.push(
+              [&, bytes]() {
+                executed++;
+                held -= bytes;
+                tracker.done(true);
+              },
+              bytes);
+          // counted once queued, so held never exceeds the queued bytes
+          long now = (held += bytes);
+          long prev = max_held;
+          while ((now > prev) && !max_held.compare_exchange_weak(prev, now))
+            ;
+        }
+        tracker.wait();
+      }));
+    }
+    for (auto &producer : producers) {
+      producer.join();
+    }
+  }
+  bool success = (executed == (long)num_producers * num_jobs) &&
+                 (max_held <= (long)max_queued_bytes);
+  cout << "queue: " << executed << " jobs, at most " << max_held << " of "
+       << max_queued_bytes << " bytes held -> " << (success ? "ok" : "FAILED")
+       << endl;
+  return success;
+}
+
+// the writers of all blocks share one queue and their levels are handed over
+// concurrently, as ParallelBlockRefactor does
+bool test_writers(const string &dir, int num_blocks, int num_levels,
+                  int num_streams, size_t max_queued_bytes,
+                  int num_io_threads) {
+  mkdir(dir.c_str(), 0755);
+  auto level_file = [&](int b, int l) {
+    return dir + "/level_" + to_string(b) + "_" + to_string(l) + ".bin";
+  };
+  {
+    auto queue = make_shared<MDR::AsyncWriteQueue>(max_queued_bytes,
+                                                   num_io_threads);
+    vector<thread> blocks;
+    for (int b = 0; b < num_blocks; b++) {
+      blocks.push_back(thread([&, b]() {
+        vector<string> files;
+        for (int l = 0; l < num_levels; l++) {
+          files.push_back(level_file(b, l));
+        }
+        MDR::AsyncLevelFileWriter writer(
+            dir + "/metadata_" + to_string(b) + ".bin", files, queue);
+        vector<thread> levels;
+        for (int l = 0; l < num_levels; l++) {
+          levels.push_back(thread([&, l]() {
+            vector<MDR::StreamBuffer> streams;
+            vector<uint32_t> sizes;
+            for (int j = 0; j < num_streams; j++) {
+              auto stream = make_stream(b, l, j);
+              streams.push_back(MDR::StreamBuffer(stream.size()));
+              memcpy(streams.back().get(), stream.data(), stream.size());
+              sizes.push_back(stream.size());
+            }
+            writer.write_level(l, std::move(streams), sizes);
+          }));
+        }
+        for (auto &level : levels) {
+          level.join();
+        }
+        writer.finish_levels(num_levels);
+      }));
+    }
+    for (auto &block : blocks) {
+      block.join();
+    }
+  }
+  int mismatches = 0;
+  for (int b = 0; b < num_blocks; b++) {
+    for (int l = 0; l < num_levels; l++) {
+      vector<uint8_t> expected;
+      for (int j = 0; j < num_streams; j++) {
+        auto stream = make_stream(b, l, j);
+        expected.insert(expected.end(), stream.begin(), stream.end());
+      }
+      ifstream file(level_file(b, l), ios::binary);
+      vector<uint8_t> written((istreambuf_iterator<char>(file)),
+                              istreambuf_iterator<char>());
+      if (written != expected)
+        mismatches++;
+    }
+  }
+  cout << "writers: " << num_blocks * num_levels << " level files, "
+       << mismatches << " mismatches -> " << (mismatches ? "FAILED" : "ok")
+       << endl;
+  return mismatches == 0;
+}
+
+int main(int argc, char **argv) {
+  // optional: output directory and number of I/O threads
+  string dir = (argc > 1) ? string(argv[1]) : "async_writer_test";
+  int num_io_threads = (argc > 2) ? atoi(argv[2]) : 4;
+
+  bool success = true;
+  // a tight limit keeps the producers blocking on each other
+  success &= test_queue(8, 2000, 1000, num_io_threads);
+  success &= test_queue(8, 2000, 1 << 20, num_io_threads);
+  success &= test_writers(dir, 16, 4, 24, 64 << 10, num_io_threads);
+  success &= test_writers(dir, 16, 4, 24, 1, num_io_threads);
+  return success ? 0 : 1;
+}
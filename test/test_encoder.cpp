@@ -17,14 +17,14 @@ void evaluate(const vector<T>& data, size_t num_elements, int level_exp, int num
 
     vector<uint32_t> sizes;
     err = clock_gettime(CLOCK_REALTIME, &start);
-    std::vector<uint8_t*> streams = encoder.encode(data.data(), num_elements, level_exp, num_bitplanes, sizes);
+    std::vector<MDR::StreamBuffer> streams = encoder.encode(data.data(), num_elements, level_exp, num_bitplanes, sizes);
     err = clock_gettime(CLOCK_REALTIME, &end);
     cout << streams.size() << endl;
     cout << "Encoding time: " << (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec)/(double)1000000000 << "s" << endl;	
 
     std::vector<uint8_t const*> streams_const;
     for(int i=0; i<streams.size(); i++){
-        streams_const.push_back(streams[i]);
+        streams_const.push_back(streams[i].get());
     }
     err = clock_gettime(CLOCK_REALTIME, &start);
     auto dec_data = encoder.decode(streams_const, num_elements, level_exp, num_bitplanes);
@@ -34,7 +34,6 @@ void evaluate(const vector<T>& data, size_t num_elements, int level_exp, int num
     cout << "Encoded sizes: ";
     for(int i=0; i<sizes.size(); i++){
     	cout << sizes[i] << " ";
-        free(streams[i]);
     }
     cout << endl;
 
@@ -21,10 +21,10 @@ void compute_true_errors(const vector<T>& data, int num_elements, T max_value){
     int level_exp = 0;
     frexp(max_value, &level_exp);
     vector<uint32_t> sizes;
-    vector<uint8_t*> streams = encoder.encode(data.data(), num_elements, level_exp, num_bitplanes, sizes);
+    vector<MDR::StreamBuffer> streams = encoder.encode(data.data(), num_elements, level_exp, num_bitplanes, sizes);
     std::vector<uint8_t const*> streams_const;
     for(int i=0; i<streams.size(); i++){
-        streams_const.push_back(streams[i]);
+        streams_const.push_back(streams[i].get());
     }
     for(int i=1; i<=num_bitplanes; i++){
         auto dec_data = encoder.decode(streams_const, num_elements, level_exp, i);
@@ -39,9 +39,6 @@ void compute_true_errors(const vector<T>& data, int num_elements, T max_value){
         // cout << "max_error = " << max_error << ", squared_error = " << squared_error << endl;
         free(dec_data);
     }
-    for(int i=0; i<streams.size(); i++){
-        free(streams[i]);
-    }
     cout << "True max errors: " << endl;
     for(int i=0; i<true_max_error.size(); i++){
         cout << true_max_error[i] << " ";
@@ -6,6 +6,8 @@
 #include <iostream>
 #include <vector>
 #include <fstream>
+#include <functional>
+#include <type_traits>
 #include <omp.h>
 
 #include "utils.hpp"
@@ -13,17 +15,23 @@
 #include "Reconstructor/Reconstructor.hpp"
 
 #define NUM_CORES 16
-#define NUM_BLOCKS 16
 
 using namespace std;
 
-template <class T, class Reconstructor>
-void evaluate_reconstructor_parallel(const vector<T> &data,
-                                     const vector<double> &tolerance,
-                                     vector<Reconstructor> &reconstructors) {
-  struct timespec start, end;
-  std::vector<size_t> total_size(tolerance.size(), 0);
+// reconstruction modes checked against the default one
+enum ReconstructMode {
+  RECONSTRUCT_DEFAULT = 0,
+  RECONSTRUCT_PREFETCH = 1,
+  RECONSTRUCT_PIPELINED = 2
+};
 
+// check is called with every step and returns false if it differs from the
+// reference reconstruction
+template <class T, class Reconstructor>
+void evaluate_reconstructor_parallel(
+    const vector<T> &data, const vector<double> &tolerance,
+    Reconstructor &reconstructor, bool prefetch = false,
+    std::function<bool(double, const vector<T> &)> check = nullptr) {
   std::ofstream outfile("retrieved_size.txt", std::ios::app);
   if (!outfile.is_open()) {
     std::cerr << "[ERROR] Failed to open retrieved_size.txt for writing." << std::endl;
@@ -32,88 +40,115 @@ void evaluate_reconstructor_parallel(const vector<T> &data,
 
   outfile << "==== Results ====" << std::endl;
 
+  vector<T> reconstructed_data(data.size(), 0);
   for (int j = 0; j < tolerance.size(); j++) {
-    std::vector<size_t> thread_local_sizes(NUM_BLOCKS, 0);
-
-    clock_gettime(CLOCK_REALTIME, &start);
-    #pragma omp parallel for num_threads(NUM_CORES)
-    for (int i = 0; i < NUM_BLOCKS; i++) {
-      auto reconstructed_data =
-          reconstructors[i].progressive_reconstruct(tolerance[j], -1);
-      auto size_vec = reconstructors[i].getLastRetrieveSizes();
-
-      for (auto size : size_vec) {
-        thread_local_sizes[i] += size;
-      }
+    // read the bitplanes of the next tolerance while this one is decoded
+    if (prefetch && (j + 1 < tolerance.size()))
+      reconstructor.prefetch_tolerance(tolerance[j + 1]);
+    auto stats = reconstructor.progressive_reconstruct(
+        tolerance[j], reconstructed_data.data(), -1);
+
+    T max_error = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+      max_error = std::max(max_error, (T)fabs(data[i] - reconstructed_data[i]));
     }
-    clock_gettime(CLOCK_REALTIME, &end);
-    double elapsed =
-      (double)(end.tv_sec - start.tv_sec) +
-      (double)(end.tv_nsec - start.tv_nsec) / 1e9;
-
-    for (int i = 0; i < NUM_BLOCKS; i++) {
-      total_size[j] += thread_local_sizes[i];
+    cout << "tolerance " << tolerance[j] << " -> max error = " << max_error
+         << endl;
+    if (check && !check(tolerance[j], reconstructed_data)) {
+      std::cerr << "[ERROR] tolerance " << tolerance[j]
+                << " differs from the default reconstruction" << std::endl;
+      exit(-1);
     }
 
     outfile << "tolerance " << tolerance[j]
-            << " -> retrieved size = " << total_size[j] << " bytes -> retrieved time = " << elapsed << std::endl;
+            << " -> retrieved size = " << stats.retrieved_size << " bytes -> retrieved time = " << stats.time << std::endl;
   }
 
   outfile << std::endl;
   outfile.close();
 }
 
-
+template <class T, class Decomposer, class Interleaver, class Encoder,
+          class Compressor, class ErrorEstimator, class SizeInterpreter,
+          class BlockRetriever>
+MDR::ParallelBlockReconstructor<T, Decomposer, Interleaver, Encoder, Compressor,
+                                SizeInterpreter, ErrorEstimator,
+                                typename std::result_of<BlockRetriever(
+                                    uint32_t, uint8_t)>::type>
+make_reconstructor(int num_threads, Decomposer decomposer,
+                   Interleaver interleaver, Encoder encoder,
+                   Compressor compressor, SizeInterpreter interpreter,
+                   BlockRetriever block_retriever) {
+  MDR::ParallelBlockReconstructor<T, Decomposer, Interleaver, Encoder,
+                                  Compressor, SizeInterpreter, ErrorEstimator,
+                                  typename std::result_of<BlockRetriever(
+                                      uint32_t, uint8_t)>::type>
+      reconstructor(decomposer, interleaver, encoder, compressor, interpreter,
+                    block_retriever, "refactored_data/layout.bin");
+  reconstructor.set_num_threads(num_threads);
+  return reconstructor;
+}
 
 template <class T, class Decomposer, class Interleaver, class Encoder,
           class Compressor, class ErrorEstimator, class SizeInterpreter,
           class Retriever>
-void test(string filename, const vector<double> &tolerance,
-          Decomposer decomposer, Interleaver interleaver, Encoder encoder,
-          Compressor compressor, ErrorEstimator estimator,
+void test(string filename, const vector<double> &tolerance, int num_threads,
+          int mode, Decomposer decomposer, Interleaver interleaver,
+          Encoder encoder, Compressor compressor, ErrorEstimator estimator,
           SizeInterpreter interpreter, Retriever retriever) {
-
-  std::vector<MDR::ComposedReconstructor<T, Decomposer, Interleaver, Encoder,
-                                         Compressor, SizeInterpreter,
-                                         ErrorEstimator, Retriever>>
-      reconstructors;
-
-  for (int i = 0; i < NUM_BLOCKS; ++i) {
-    string metadata_file = "refactored_data/metadata_" + to_string(i) + ".bin";
-    int num_levels = 0;
-    int num_dims = 0;
-
-    size_t num_bytes = 0;
-    auto metadata = MGARD::readfile<uint8_t>(metadata_file.c_str(), num_bytes);
-    
-    num_dims = metadata[0];
-    num_levels = metadata[num_dims * sizeof(uint32_t) + 1];
-    // assert(num_bytes > num_dims * sizeof(uint32_t) + 2);
-
-    vector<string> files;
-    for (int j = 0; j < num_levels; j++) {
-      string filename =
-          "refactored_data/level_" + to_string(j) + "_" + to_string(i) + ".bin";
-      files.push_back(filename);
-    }
-
-    auto new_retriever = MDR::ConcatLevelFileRetriever(metadata_file, files);
-
-    auto reconstructor =
-      MDR::ComposedReconstructor<T, Decomposer, Interleaver, Encoder,
-                                 Compressor, SizeInterpreter, ErrorEstimator,
-                                 Retriever>(decomposer, interleaver, encoder,
-                                            compressor, interpreter, new_retriever);
-
-    reconstructors.emplace_back(decomposer, interleaver, encoder, compressor,
-                                interpreter, new_retriever);
-              
-    reconstructors.back().load_metadata();
-  }
+  // every block reads from the container shared with retriever
+  auto block_retriever = [retriever](uint32_t block_id, uint8_t target_level) {
+    return retriever.for_block(block_id);
+  };
+  auto reconstructor =
+      make_reconstructor<T, Decomposer, Interleaver, Encoder, Compressor,
+                         ErrorEstimator>(num_threads, decomposer, interleaver,
+                                         encoder, compressor, interpreter,
+                                         block_retriever);
+  reconstructor.load_metadata();
 
   size_t num_elements = 0;
   auto data = MGARD::readfile<T>(filename.c_str(), num_elements);
-  evaluate_reconstructor_parallel(data, tolerance, reconstructors);
+  if (mode == RECONSTRUCT_DEFAULT) {
+    evaluate_reconstructor_parallel(data, tolerance, reconstructor);
+    return;
+  }
+
+  // the default reconstruction runs alongside as the reference
+  vector<T> reference_data(data.size(), 0);
+  auto check = [&](double tolerance, const vector<T> &reconstructed_data) {
+    reconstructor.progressive_reconstruct(tolerance, reference_data.data(),
+                                          -1);
+    return reference_data == reconstructed_data;
+  };
+  if (mode == RECONSTRUCT_PREFETCH) {
+    auto prefetch_block_retriever = [retriever](uint32_t block_id,
+                                                uint8_t target_level) {
+      return MDR::PrefetchRetriever<Retriever>(retriever.for_block(block_id));
+    };
+    auto prefetch_reconstructor =
+        make_reconstructor<T, Decomposer, Interleaver, Encoder, Compressor,
+                           ErrorEstimator>(num_threads, decomposer, interleaver,
+                                           encoder, compressor, interpreter,
+                                           prefetch_block_retriever);
+    prefetch_reconstructor.load_metadata();
+    evaluate_reconstructor_parallel<T>(data, tolerance, prefetch_reconstructor,
+                                       true, check);
+  } else if (mode == RECONSTRUCT_PIPELINED) {
+    auto pipelined_reconstructor =
+        make_reconstructor<T, Decomposer, Interleaver, Encoder, Compressor,
+                           ErrorEstimator>(num_threads, decomposer, interleaver,
+                                           encoder, compressor, interpreter,
+                                           block_retriever);
+    pipelined_reconstructor.set_pipelined(true);
+    pipelined_reconstructor.load_metadata();
+    evaluate_reconstructor_parallel<T>(data, tolerance,
+                                       pipelined_reconstructor, false, check);
+  } else {
+    std::cerr << "[ERROR] Unknown reconstruction mode " << mode << std::endl;
+    exit(-1);
+  }
+  cout << "Reconstruction matches the default one" << endl;
 }
 
 int main(int argc, char **argv) {
@@ -128,24 +163,24 @@ int main(int argc, char **argv) {
   }
   double s = atof(argv[argv_id++]);
 
-  string metadata_file = "refactored_data/metadata.bin";
+  // optional: number of threads and reconstruction mode (0: default,
+  // 1: prefetch the next tolerance, 2: pipeline the levels of each step),
+  // other modes are checked against the default one
+  int num_threads = (argc > argv_id) ? atoi(argv[argv_id++]) : NUM_CORES;
+  int mode = (argc > argv_id) ? atoi(argv[argv_id++]) : RECONSTRUCT_DEFAULT;
+
+  string layout_file = "refactored_data/layout.bin";
   int num_levels = 0;
   int num_dims = 0;
   {
-    // metadata interpreter, otherwise information needs to be provided
+    // block layout: number of levels, then number of dimensions
     size_t num_bytes = 0;
-    auto metadata = MGARD::readfile<uint8_t>(metadata_file.c_str(), num_bytes);
-    assert(num_bytes > num_dims * sizeof(uint32_t) + 2);
-    num_dims = metadata[0];
-    num_levels = metadata[num_dims * sizeof(uint32_t) + 1];
-    // cout << "number of dimension = " << num_dims
-    //      << ", number of levels = " << num_levels << endl;
-  }
-  vector<string> files;
-  for (int i = 0; i < num_levels; i++) {
-    string filename = "refactored_data/level_" + to_string(i) + ".bin";
-    files.push_back(filename);
+    auto metadata = MGARD::readfile<uint8_t>(layout_file.c_str(), num_bytes);
+    assert(num_bytes > 2);
+    num_levels = metadata[0];
+    num_dims = metadata[1];
   }
+  string container_file = "refactored_data/blocks.mdr";
 
   using T = float;
   using T_stream = uint32_t;
@@ -160,7 +195,8 @@ int main(int argc, char **argv) {
   // auto compressor = MDR::DefaultLevelCompressor();
   auto compressor = MDR::AdaptiveLevelCompressor(32);
   // auto compressor = MDR::NullLevelCompressor();
-  auto retriever = MDR::ConcatLevelFileRetriever(metadata_file, files);
+  auto container = std::make_shared<MDR::ContainerFileReader>(container_file);
+  auto retriever = MDR::ContainerFileRetriever(container);
   switch (error_mode) {
   case 1: {
     auto estimator = MDR::SNormErrorEstimator<T>(num_dims, num_levels - 1, s);
@@ -176,8 +212,8 @@ int main(int argc, char **argv) {
     // estimator = MDR::L2ErrorEstimator_HB<T>(num_dims, num_levels - 1); auto
     // interpreter =
     // MDR::SignExcludeGreedyBasedSizeInterpreter<MDR::L2ErrorEstimator_HB<T>>(estimator);
-    test<T>(filename, tolerance, decomposer, interleaver, encoder, compressor,
-            estimator, interpreter, retriever);
+    test<T>(filename, tolerance, num_threads, mode, decomposer, interleaver,
+            encoder, compressor, estimator, interpreter, retriever);
     break;
   }
   default: {
@@ -191,8 +227,8 @@ int main(int argc, char **argv) {
     // MDR::InorderSizeInterpreter<MDR::MaxErrorEstimatorOB<T>>(estimator); auto
     // estimator = MDR::MaxErrorEstimatorHB<T>(); auto interpreter =
     // MDR::SignExcludeGreedyBasedSizeInterpreter<MDR::MaxErrorEstimatorHB<T>>(estimator);
-    test<T>(filename, tolerance, decomposer, interleaver, encoder, compressor,
-            estimator, interpreter, retriever);
+    test<T>(filename, tolerance, num_threads, mode, decomposer, interleaver,
+            encoder, compressor, estimator, interpreter, retriever);
   }
   }
   return 0;
@@ -86,6 +86,9 @@ int main(int argc, char **argv) {
   // auto compressor = MDR::NullLevelCompressor();
   auto collector = MDR::SquaredErrorCollector<T>();
   auto writer = MDR::ConcatLevelFileWriter(metadata_file, files);
+  // write each level on a background thread while the next ones are encoded
+  // auto writer = MDR::AsyncLevelFileWriter(metadata_file, files,
+  // std::make_shared<MDR::AsyncWriteQueue>());
   // auto writer = MDR::HPSSFileWriter(metadata_file, files, 2048, 512 * 1024 *
   // 1024);
 
@@ -19,56 +19,21 @@ using namespace std;
 
 
 template <class T, class Refactor>
-void evaluate_refactor_parallel(const vector<T> &data,
+void evaluate_refactor_parallel(vector<T> &data,
                                 const vector<uint32_t> &dims, int target_level,
-                                int num_bitplanes,
-                                vector<Refactor> &refactors) {
+                                int num_bitplanes, Refactor &refactor) {
   struct timespec start, end;
-  cout << "Start parallel refactoring with " << NUM_BLOCKS << " blocks."
-       << endl;
-
-  const size_t total_size = data.size();
-  const uint32_t nz = dims[0], ny = dims[1], nx = dims[2];
-  const size_t chunk_z = (nz + NUM_BLOCKS - 1) / NUM_BLOCKS;
-
-  omp_set_num_threads(NUM_CORES);
   clock_gettime(CLOCK_REALTIME, &start);
-#pragma omp parallel for num_threads(NUM_CORES)
-  for (int i = 0; i < NUM_BLOCKS; ++i) {
-    size_t z_start = i * chunk_z;
-    size_t z_end = std::min(z_start + chunk_z, static_cast<size_t>(nz));
-    if (z_start >= z_end)
-      continue;
-
-    size_t z_len = z_end - z_start;
-    std::vector<uint32_t> local_dims = dims;
-    local_dims[0] = z_len;
-
-    size_t offset = z_start * ny * nx;
-    size_t chunk_elements = z_len * ny * nx;
-
-    if (offset + chunk_elements > data.size()) {
-      std::cerr << "Chunk " << i << " out of bounds! offset = " << offset
-                << ", chunk = " << chunk_elements << ", total = " << data.size()
-                << std::endl;
-      continue;
-    }
-
-    if (local_dims[0] < 2 || local_dims[1] < 2 || local_dims[2] < 2) {
-      std::cerr << "Chunk " << i << " too small! dims = [" << local_dims[0]
-                << ", " << local_dims[1] << ", " << local_dims[2]
-                << "] — skipping\n";
-      continue;
-    }
-
-    Refactor refactor = refactors[i];
-    refactor.refactor(&data[offset], local_dims, target_level, num_bitplanes);
-  }
+  // data is not needed afterwards: decompose it in place instead of copying
+  refactor.refactor_in_place(data.data(), dims, target_level, num_bitplanes);
   clock_gettime(CLOCK_REALTIME, &end);
   double elapsed =
       (double)(end.tv_sec - start.tv_sec) +
       (double)(end.tv_nsec - start.tv_nsec) / 1e9;
 
+  cout << "Parallel refactoring with " << refactor.get_layout().num_blocks()
+       << " blocks." << endl;
+  refactor.get_layout().print();
   std::cout << "Refactor (parallel) time: " << elapsed << "s" << std::endl;
 
   std::ofstream outfile("refactor_time.txt", std::ios::app);
@@ -85,34 +50,28 @@ void evaluate_refactor_parallel(const vector<T> &data,
 template <class T, class Decomposer, class Interleaver, class Encoder,
           class Compressor, class ErrorCollector, class Writer>
 void test(string filename, const vector<uint32_t> &dims, int target_level,
-          int num_bitplanes, Decomposer decomposer, Interleaver interleaver,
-          Encoder encoder, Compressor compressor, ErrorCollector collector,
-          Writer writer) {
+          int num_bitplanes, int num_threads, int num_blocks,
+          Decomposer decomposer, Interleaver interleaver, Encoder encoder,
+          Compressor compressor, ErrorCollector collector, Writer writer) {
   size_t num_elements = 0;
   auto data = MGARD::readfile<T>(filename.c_str(), num_elements);
 
-  std::vector<MDR::ComposedRefactor<T, Decomposer, Interleaver, Encoder,
-                                    Compressor, ErrorCollector, Writer>>
-      refactors;
-  for (int i = 0; i < NUM_BLOCKS; ++i) {
-    string meta_file = "refactored_data/metadata_" + to_string(i) + ".bin";
-    vector<string> level_files;
-    for (int l = 0; l <= target_level; ++l) {
-      level_files.push_back("refactored_data/level_" + to_string(l) + "_" +
-                            to_string(i) + ".bin");
-    }
-    auto block_writer = MDR::ConcatLevelFileWriter(meta_file, level_files);
-    refactors.emplace_back(decomposer, interleaver, encoder, compressor,
-                           collector, block_writer);
-  }
+  // every block writes into the container shared with writer
+  auto block_writer = [writer](uint32_t block_id, uint8_t target_level) {
+    return writer.for_block(block_id);
+  };
+  MDR::ParallelBlockRefactor<T, Decomposer, Interleaver, Encoder, Compressor,
+                             ErrorCollector, Writer>
+      refactor(decomposer, interleaver, encoder, compressor, collector,
+               block_writer, "refactored_data/layout.bin");
+  refactor.set_num_threads(num_threads);
+  refactor.set_num_blocks(num_blocks);
 
   evaluate_refactor_parallel(data, dims, target_level, num_bitplanes,
-                             refactors);
+                             refactor);
 }
 
 int main(int argc, char **argv) {
-  omp_set_num_threads(NUM_CORES);
-
   int argv_id = 1;
   string filename = string(argv[argv_id++]);
   int target_level = atoi(argv[argv_id++]);
@@ -128,13 +87,16 @@ int main(int argc, char **argv) {
   for (int i = 0; i < num_dims; i++) {
     dims[i] = atoi(argv[argv_id++]);
   }
+  // optional: number of threads and number of blocks
+  int num_threads = (argc > argv_id) ? atoi(argv[argv_id++]) : NUM_CORES;
+  int num_blocks = (argc > argv_id) ? atoi(argv[argv_id++]) : NUM_BLOCKS;
+  // -k blocks: over-decompose to k blocks per thread so that the block
+  // scheduler can balance uneven blocks
+  if (num_blocks < 0)
+    num_blocks = -num_blocks * num_threads;
 
-  string metadata_file = "refactored_data/metadata.bin";
-  vector<string> files;
-  for (int i = 0; i <= target_level; i++) {
-    string filename = "refactored_data/level_" + to_string(i) + ".bin";
-    files.push_back(filename);
-  }
+  // all blocks and levels are stored in one container next to the block layout
+  string container_file = "refactored_data/blocks.mdr";
 
   using T = float;
   using T_stream = uint32_t;
@@ -156,11 +118,18 @@ int main(int argc, char **argv) {
   auto compressor = MDR::AdaptiveLevelCompressor(32);
   // auto compressor = MDR::NullLevelCompressor();
   auto collector = MDR::SquaredErrorCollector<T>();
-  auto writer = MDR::ConcatLevelFileWriter(metadata_file, files);
-  // auto writer = MDR::HPSSFileWriter(metadata_file, files, 2048, 512 * 1024 *
-  // 1024);
-
-  test<T>(filename, dims, target_level, num_bitplanes, decomposer, interleaver,
-          encoder, compressor, collector, writer);
+  auto container = std::make_shared<MDR::ContainerFileBuilder>(container_file);
+  // store bitplane k of level l of all blocks together, so that a progressive
+  // step reads one range per level; bitplanes are staged in memory until close
+  // auto container = std::make_shared<MDR::ContainerFileBuilder>(
+  //     container_file, MDR::CONTAINER_PLANE_MAJOR);
+  auto writer = MDR::ContainerFileWriter(container);
+
+  test<T>(filename, dims, target_level, num_bitplanes, num_threads, num_blocks,
+          decomposer, interleaver, encoder, compressor, collector, writer);
+  // append the index of all blocks
+  if (!container->close()) {
+    exit(-1);
+  }
   return 0;
 }
\ No newline at end of file